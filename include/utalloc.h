@@ -0,0 +1,420 @@
+// ННГУ, ВМК, Курс "Методы программирования-2", С++, ООП
+//
+// utalloc.h
+//
+// Распределение памяти под буферы TVector и TMatrix: выровненные блоки и
+// стратегии-распределители, передаваемые параметром шаблона.
+//   TDefaultAlloc - каждый буфер берётся из кучи и возвращается в неё;
+//   TPoolAlloc    - пул блоков по классам размеров, повторное использование
+//                   освобождённых блоков без обращения к куче;
+//   TArenaAlloc   - поточная арена: выделение сдвигом указателя, память
+//                   возвращается целиком при выходе из TArenaScope;
+//   TCowAlloc     - разделяемые буферы со счётчиком ссылок (копирование
+//                   при записи) поверх любой из стратегий выше;
+//   TSmallAlloc   - короткие векторы хранятся внутри объекта (малый буфер),
+//                   длинные - в памяти стратегии Base.
+// Стратегия - класс со статическими функциями
+//   void* Allocate(size_t bytes);      // блок с границы VECTOR_ALIGNMENT
+//   void* AllocateZero(size_t bytes);  // то же, заполненный нулями
+//   void  Free(void *p, size_t bytes); // bytes - размер из Allocate
+// и признаком Shared с функциями счётчика ссылок AddRef, Release, Unique
+// и запрета разделения Seal, Shareable (для неразделяемых буферов -
+// пустыми, см. TUniqueBuffer), а также размером малого буфера LocalSize
+// (0 - малого буфера нет).
+
+#ifndef __UTALLOC_H__
+#define __UTALLOC_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Выравнивание памяти векторов и матриц (по умолчанию - строка кэша).
+// Буфер начинается с границы VECTOR_ALIGNMENT и дополняется до кратного
+// ей размера, поэтому соседние буферы не делят строку кэша.
+#ifndef UT_VECTOR_ALIGNMENT
+#define UT_VECTOR_ALIGNMENT 64
+#endif
+
+const int VECTOR_ALIGNMENT = UT_VECTOR_ALIGNMENT;
+
+static_assert((VECTOR_ALIGNMENT & (VECTOR_ALIGNMENT - 1)) == 0 &&
+  VECTOR_ALIGNMENT >= (int)sizeof(void*), "UT_VECTOR_ALIGNMENT must be a power of two");
+
+// размер bytes, дополненный до кратного VECTOR_ALIGNMENT
+inline size_t AlignedSize(size_t bytes)
+{
+	return (bytes + VECTOR_ALIGNMENT - 1) & ~(size_t)(VECTOR_ALIGNMENT - 1);
+} /*-------------------------------------------------------------------------*/
+
+// Выделение bytes байт с границы VECTOR_ALIGNMENT. Адрес исходного блока
+// хранится непосредственно перед выровненным; младший бит адреса отмечает
+// блок, полученный от calloc.
+inline void* AlignedAttach(char *raw, bool zeroed)
+{
+	char *p = raw + VECTOR_ALIGNMENT - ((size_t)raw & (VECTOR_ALIGNMENT - 1));
+	reinterpret_cast<char**>(p)[-1] = raw + (zeroed ? 1 : 0);
+	return p;
+} /*-------------------------------------------------------------------------*/
+
+inline void* AlignedAlloc(size_t bytes)
+{
+	return AlignedAttach(static_cast<char*>(::operator new(AlignedSize(bytes) + VECTOR_ALIGNMENT)), false);
+} /*-------------------------------------------------------------------------*/
+
+// выделение обнулённой памяти; большие блоки берутся у calloc, который
+// отдаёт свежие страницы ОС уже нулевыми, без прохода memset
+const size_t CALLOC_THRESHOLD = 1 << 20;
+
+inline void* AlignedAllocZero(size_t bytes)
+{
+	size_t total = AlignedSize(bytes) + VECTOR_ALIGNMENT;
+	if (total < CALLOC_THRESHOLD)
+	{
+		char *raw = static_cast<char*>(::operator new(total));
+		memset(raw, 0, total);
+		return AlignedAttach(raw, false);
+	}
+	char *raw = static_cast<char*>(calloc(total, 1));
+	if (!raw) throw std::bad_alloc();
+	return AlignedAttach(raw, true);
+} /*-------------------------------------------------------------------------*/
+
+inline void AlignedFree(void *p)
+{
+	if (!p) return;
+	char *raw = reinterpret_cast<char**>(p)[-1];
+	if ((size_t)raw & 1)
+		free(raw - 1);
+	else
+		::operator delete(raw);
+} /*-------------------------------------------------------------------------*/
+
+// Буфер принадлежит одному вектору: копия вектора копирует элементы
+struct TUniqueBuffer
+{
+	static const bool Shared = false;
+	static const int LocalSize = 0;
+	static void AddRef(void *)       {              }
+	static bool Release(void *)      { return true; } // последняя ли ссылка
+	static bool Unique(const void *) { return true; }
+	static void Seal(void *)            {               } // буфер больше не разделять
+	static bool Shareable(const void *) { return false; } // можно ли разделить буфер
+};
+
+// Распределитель по умолчанию: каждый буфер - отдельный блок кучи
+struct TDefaultAlloc : TUniqueBuffer
+{
+	static void* Allocate(size_t bytes)     { return AlignedAlloc(bytes);     }
+	static void* AllocateZero(size_t bytes) { return AlignedAllocZero(bytes); }
+	static void  Free(void *p, size_t)      { AlignedFree(p);                 }
+};
+
+// Пул блоков по классам размеров. Запрос округляется вверх до степени
+// двойки (не меньше VECTOR_ALIGNMENT); освобождённый блок попадает в
+// список своего класса у освобождающего потока и выдаётся следующему
+// запросу того же класса без обращения к куче. Каждый поток хранит не
+// более POOL_CACHE_LIMIT байт свободных блоков, остальное возвращается
+// в кучу; блоки больше POOL_MAX_BLOCK идут в кучу напрямую.
+const int POOL_CLASSES = 21;
+const size_t POOL_MAX_BLOCK = (size_t)VECTOR_ALIGNMENT << (POOL_CLASSES - 1);
+const size_t POOL_CACHE_LIMIT = 256 << 20;
+
+class TPoolAlloc : public TUniqueBuffer
+{
+	struct TCache
+	{
+		void *Head[POOL_CLASSES]; // списки свободных блоков (ссылка - в начале блока)
+		size_t Bytes;             // объём свободных блоков в списках
+
+		TCache(): Bytes(0)
+		{
+			for (int c = 0; c < POOL_CLASSES; c++)
+				Head[c] = 0;
+		}
+		~TCache()
+		{
+			for (int c = 0; c < POOL_CLASSES; c++)
+			{
+				while (Head[c])
+				{
+					void *p = Head[c];
+					Head[c] = *static_cast<void**>(p);
+					AlignedFree(p);
+				}
+			}
+		}
+	};
+
+	static TCache& Cache()
+	{
+		static thread_local TCache cache;
+		return cache;
+	}
+
+	static int SizeClass(size_t bytes)
+	{
+		int c = 0;
+		while (((size_t)VECTOR_ALIGNMENT << c) < bytes)
+			c++;
+		return c;
+	}
+public:
+	static void* Allocate(size_t bytes)
+	{
+		if (bytes > POOL_MAX_BLOCK) return AlignedAlloc(bytes);
+		int c = SizeClass(bytes);
+		TCache &cache = Cache();
+		void *p = cache.Head[c];
+		if (!p) return AlignedAlloc((size_t)VECTOR_ALIGNMENT << c);
+		cache.Head[c] = *static_cast<void**>(p);
+		cache.Bytes -= (size_t)VECTOR_ALIGNMENT << c;
+		return p;
+	}
+
+	static void* AllocateZero(size_t bytes)
+	{
+		void *p = Allocate(bytes);
+		memset(p, 0, bytes);
+		return p;
+	}
+
+	static void Free(void *p, size_t bytes)
+	{
+		if (!p) return;
+		if (bytes > POOL_MAX_BLOCK) {
+			AlignedFree(p);
+			return;
+		}
+		int c = SizeClass(bytes);
+		TCache &cache = Cache();
+		if (cache.Bytes + ((size_t)VECTOR_ALIGNMENT << c) > POOL_CACHE_LIMIT) {
+			AlignedFree(p);
+			return;
+		}
+		*static_cast<void**>(p) = cache.Head[c];
+		cache.Head[c] = p;
+		cache.Bytes += (size_t)VECTOR_ALIGNMENT << c;
+	}
+};
+
+// Поточная арена. Память выдаётся сдвигом указателя в текущем куске (не
+// меньше ARENA_CHUNK байт); освобождение - O(1): последний выданный блок
+// возвращается сдвигом назад (временные результаты выражений освобождаются
+// именно в таком порядке), остальные блоки остаются занятыми до выхода из
+// TArenaScope. Объекты с TArenaAlloc не должны переживать область
+// TArenaScope, в которой созданы, и передаваться другим потокам.
+const size_t ARENA_CHUNK = 1 << 20;
+
+class TArenaAlloc : public TUniqueBuffer
+{
+	struct TChunk
+	{
+		TChunk *Prev; // предыдущий кусок
+		char *End;    // конец памяти куска
+	};
+
+	struct TState
+	{
+		TChunk *Chunk; // текущий кусок
+		char *Top;     // первый свободный байт текущего куска
+
+		TState(): Chunk(0), Top(0) {}
+		~TState() { Rewind(0, 0); }
+
+		void Rewind(TChunk *chunk, char *top)
+		{
+			while (Chunk != chunk)
+			{
+				TChunk *prev = Chunk->Prev;
+				AlignedFree(Chunk);
+				Chunk = prev;
+			}
+			Top = top;
+		}
+	};
+
+	static TState& State()
+	{
+		static thread_local TState state;
+		return state;
+	}
+
+	static size_t HeaderSize() { return AlignedSize(sizeof(TChunk)); }
+
+	friend class TArenaScope;
+public:
+	static void* Allocate(size_t bytes)
+	{
+		TState &s = State();
+		size_t len = AlignedSize(bytes);
+		if (!s.Chunk || (size_t)(s.Chunk->End - s.Top) < len)
+		{
+			size_t size = HeaderSize() + (len > ARENA_CHUNK ? len : ARENA_CHUNK);
+			TChunk *chunk = static_cast<TChunk*>(AlignedAlloc(size));
+			chunk->Prev = s.Chunk;
+			chunk->End = reinterpret_cast<char*>(chunk) + size;
+			s.Chunk = chunk;
+			s.Top = reinterpret_cast<char*>(chunk) + HeaderSize();
+		}
+		void *p = s.Top;
+		s.Top += len;
+		return p;
+	}
+
+	static void* AllocateZero(size_t bytes)
+	{
+		void *p = Allocate(bytes);
+		memset(p, 0, bytes);
+		return p;
+	}
+
+	static void Free(void *p, size_t bytes)
+	{
+		TState &s = State();
+		if (p && static_cast<char*>(p) + AlignedSize(bytes) == s.Top)
+			s.Top = static_cast<char*>(p);
+	}
+
+	// объём памяти, выданной из текущего куска
+	static size_t Used()
+	{
+		TState &s = State();
+		return s.Chunk ? s.Top - reinterpret_cast<char*>(s.Chunk) - HeaderSize() : 0;
+	}
+};
+
+// Область арены текущего потока: при выходе вся память, выданная
+// TArenaAlloc внутри области, возвращается, куски сверх отметки
+// освобождаются.
+class TArenaScope
+{
+	TArenaAlloc::TChunk *Chunk;
+	char *Top;
+
+	TArenaScope(const TArenaScope&);
+	TArenaScope& operator=(const TArenaScope&);
+public:
+	TArenaScope(): Chunk(TArenaAlloc::State().Chunk), Top(TArenaAlloc::State().Top) {}
+	~TArenaScope() { TArenaAlloc::State().Rewind(Chunk, Top); }
+};
+
+// Копирование при записи. Буфер получает от Base на VECTOR_ALIGNMENT байт
+// больше, в начале хранится атомарный счётчик ссылок, сами элементы
+// остаются выровненными. Копия вектора только увеличивает счётчик, первая
+// изменяющая операция над разделяемым буфером (присваивание элементов,
+// операции на месте) делает собственную копию. Буфер, из которого наружу
+// ушла изменяемая ссылка (неконстантные operator[], at) или на который
+// взято представление (TVector::View, в том числе константное),
+// запечатывается (Seal) и больше не разделяется: копии такого вектора
+// копируют элементы, иначе запись по ссылке изменила бы копии, а
+// представление после записи в вектор осталось бы в буфере копии.
+// TArenaAlloc в качестве Base не годится: буфер может пережить область
+// арены в копии.
+template <class Base = TDefaultAlloc>
+struct TCowAlloc
+{
+	typedef std::atomic<int> TCounter;
+
+	// заголовок буфера, лежит перед элементами
+	struct THeader
+	{
+		TCounter Count; // число векторов, разделяющих буфер
+		bool Sealed;    // на буфер есть представления: не разделять
+
+		THeader(): Count(1), Sealed(false) {}
+	};
+	static_assert(sizeof(THeader) <= (size_t)VECTOR_ALIGNMENT, "TCowAlloc header does not fit");
+
+	static const bool Shared = true;
+	static const int LocalSize = 0;
+
+	static THeader& Header(const void *p)
+	{
+		return *reinterpret_cast<THeader*>(const_cast<char*>(static_cast<const char*>(p)) - VECTOR_ALIGNMENT);
+	}
+
+	static TCounter& Counter(const void *p)
+	{
+		return Header(p).Count;
+	}
+
+	static void* Allocate(size_t bytes)
+	{
+		char *b = static_cast<char*>(Base::Allocate(bytes + VECTOR_ALIGNMENT));
+		new (b) THeader;
+		return b + VECTOR_ALIGNMENT;
+	}
+
+	static void* AllocateZero(size_t bytes)
+	{
+		char *b = static_cast<char*>(Base::AllocateZero(bytes + VECTOR_ALIGNMENT));
+		new (b) THeader;
+		return b + VECTOR_ALIGNMENT;
+	}
+
+	static void Free(void *p, size_t bytes)
+	{
+		if (!p) return;
+		Header(p).~THeader();
+		Base::Free(static_cast<char*>(p) - VECTOR_ALIGNMENT, bytes + VECTOR_ALIGNMENT);
+	}
+
+	static void AddRef(void *p)
+	{
+		Counter(p).fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static bool Release(void *p)
+	{
+		return Counter(p).fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+
+	static bool Unique(const void *p)
+	{
+		return Counter(p).load(std::memory_order_acquire) == 1;
+	}
+
+	// запечатывается только буфер с единственным владельцем (после
+	// Detach), поэтому признак не нужно делать атомарным
+	static void Seal(void *p)
+	{
+		Header(p).Sealed = true;
+	}
+
+	static bool Shareable(const void *p)
+	{
+		return !Header(p).Sealed;
+	}
+};
+
+// Малый буфер: векторы не длиннее N элементов хранят элементы внутри
+// объекта TVector и не обращаются к распределителю; длинные получают
+// память от Base. Элементы малого буфера выровнены только по alignof(T).
+// Разделяемые буферы (TCowAlloc) в качестве Base не поддерживаются.
+template <int N = 16, class Base = TDefaultAlloc>
+struct TSmallAlloc : Base
+{
+	static_assert(!Base::Shared, "TSmallAlloc cannot wrap a shared buffer policy");
+	static const int LocalSize = N;
+};
+
+// место под LocalSize элементов внутри объекта вектора
+template <class T, int N>
+class TLocalBuffer
+{
+	alignas(T) char Local[N * sizeof(T)];
+protected:
+	T* LocalData() const { return reinterpret_cast<T*>(const_cast<char*>(Local)); }
+};
+
+template <class T>
+class TLocalBuffer<T, 0>
+{
+protected:
+	T* LocalData() const { return 0; }
+};
+
+#endif
@@ -0,0 +1,433 @@
+// ННГУ, ВМК, Курс "Методы программирования-2", С++, ООП
+//
+// utbatch.h
+//
+// Пакеты из многих матриц (векторов) одного размера в одном буфере.
+//
+// Элементы хранятся с чередованием: одноимённые элементы всех матриц пакета
+// лежат подряд, элемент (i, j) матрицы b - pData[Index(i, j) * Stride + b],
+// где Stride - число матриц, округлённое вверх до строки кэша. Операции над
+// пакетом идут по элементам матрицы, а внутренний цикл - по всему пакету:
+// для малых матриц (4x4 .. 32x32) он длинный, непрерывный и выполняется
+// векторными ядрами utsimd.h, а накладные расходы (выделение памяти,
+// проверки индексов, переходы по строкам) приходятся на весь пакет, а не на
+// каждую матрицу. Большие пакеты делятся на части по кэшу, части
+// выполняются в пуле потоков (utparallel.h).
+
+#ifndef __UTBATCH_H__
+#define __UTBATCH_H__
+
+#include "utmatrix.h"
+
+// объём кэша, в котором умещается часть пакета-множителя при умножении
+const int BATCH_CACHE_BYTES = 1024 * 1024;
+// наименьшая часть пакета: короче вызов векторного ядра не окупается
+const int BATCH_MIN_CHUNK = 256;
+
+// Общий буфер пакета: Rows строк по Stride элементов, заполнение нулями.
+// Элементы пакета за Count (выравнивание строк) всегда нулевые.
+template <class T, class Alloc = TDefaultAlloc>
+class TBatchBuffer
+{
+protected:
+  T *pData;
+  int Rows;   // число элементов одной матрицы (вектора)
+  int Count;  // число матриц (векторов) в пакете
+  int Stride; // расстояние между строками буфера, не меньше Count
+
+  static int Lane() { return VECTOR_ALIGNMENT / (int)sizeof(T) > 0 ? VECTOR_ALIGNMENT / (int)sizeof(T) : 1; }
+  int Length() const { return Rows * Stride; }
+  bool Equal(const TBatchBuffer &bb) const;
+public:
+  TBatchBuffer(int rows, int count);
+  TBatchBuffer(const TBatchBuffer &bb);
+  TBatchBuffer(TBatchBuffer &&bb) noexcept;
+  ~TBatchBuffer();
+  TBatchBuffer& operator=(const TBatchBuffer &bb);
+  TBatchBuffer& operator=(TBatchBuffer &&bb) noexcept;
+
+  int GetCount() const  { return Count;  }
+  int GetStride() const { return Stride; }
+};
+
+template <class T, class Alloc>
+TBatchBuffer<T, Alloc>::TBatchBuffer(int rows, int count): pData(0), Rows(rows), Count(count)
+{
+	if (rows < 0 || count < 0) throw - 1;
+	Stride = (count + Lane() - 1) / Lane() * Lane();
+	if ((long long)rows * Stride > MAX_VECTOR_SIZE) throw - 1;
+	pData = AlignedNewZero<Alloc, T>(Length());
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // конструктор копирования
+TBatchBuffer<T, Alloc>::TBatchBuffer(const TBatchBuffer &bb):
+  pData(0), Rows(bb.Rows), Count(bb.Count), Stride(bb.Stride)
+{
+	pData = AlignedNewFill<Alloc>(Length(), T());
+	for (int k = 0; k < Length(); k++)
+	{
+		pData[k] = bb.pData[k];
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // конструктор перемещения
+TBatchBuffer<T, Alloc>::TBatchBuffer(TBatchBuffer &&bb) noexcept:
+  pData(bb.pData), Rows(bb.Rows), Count(bb.Count), Stride(bb.Stride)
+{
+	bb.pData = 0;
+	bb.Rows = bb.Count = bb.Stride = 0;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc>
+TBatchBuffer<T, Alloc>::~TBatchBuffer()
+{
+	AlignedDelete<Alloc>(pData, Length());
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // присваивание
+TBatchBuffer<T, Alloc>& TBatchBuffer<T, Alloc>::operator=(const TBatchBuffer &bb)
+{
+	if (this == &bb) return *this;
+	if (Length() != bb.Length()) {
+		T *p = AlignedNewFill<Alloc>(bb.Length(), T());
+		AlignedDelete<Alloc>(pData, Length());
+		pData = p;
+	}
+	Rows = bb.Rows;
+	Count = bb.Count;
+	Stride = bb.Stride;
+	for (int k = 0; k < Length(); k++)
+	{
+		pData[k] = bb.pData[k];
+	}
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // присваивание перемещением
+TBatchBuffer<T, Alloc>& TBatchBuffer<T, Alloc>::operator=(TBatchBuffer &&bb) noexcept
+{
+	if (this == &bb) return *this;
+	AlignedDelete<Alloc>(pData, Length());
+	pData = bb.pData;
+	Rows = bb.Rows;
+	Count = bb.Count;
+	Stride = bb.Stride;
+	bb.pData = 0;
+	bb.Rows = bb.Count = bb.Stride = 0;
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // сравнение (выравнивание нулевое у обоих)
+bool TBatchBuffer<T, Alloc>::Equal(const TBatchBuffer &bb) const
+{
+	if (Rows != bb.Rows || Count != bb.Count) return false;
+	for (int k = 0; k < Length(); k++)
+	{
+		if (pData[k] != bb.pData[k]) return false;
+	}
+	return true;
+} /*-------------------------------------------------------------------------*/
+
+// Пакет из count векторов размера s: элемент i вектора b - pData[i * Stride + b].
+template <class T, class Alloc = TDefaultAlloc>
+class TVectorBatch : public TBatchBuffer<T, Alloc>
+{
+  template <class, class> friend class TMatrixBatch;
+public:
+  TVectorBatch(int s, int count);
+
+  int GetSize() const { return this->Rows; }
+  T& operator()(int b, int i);                   // элемент i вектора b
+  const T& operator()(int b, int i) const;
+  TVector<T> Get(int b) const;                   // копия вектора b
+  void Set(int b, const TVector<T> &v);          // записать вектор b
+  bool operator==(const TVectorBatch &vb) const { return this->Equal(vb); }
+  bool operator!=(const TVectorBatch &vb) const { return !this->Equal(vb); }
+};
+
+template <class T, class Alloc>
+TVectorBatch<T, Alloc>::TVectorBatch(int s, int count): TBatchBuffer<T, Alloc>(s, count)
+{
+	if (s < 0 || s > MAX_VECTOR_SIZE) throw - 1;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // доступ к элементу
+T& TVectorBatch<T, Alloc>::operator()(int b, int i)
+{
+	if (TDebugBoundsCheck::Enabled && (b < 0 || b >= this->Count || i < 0 || i >= this->Rows))
+		throw out_of_range("Index out of range");
+	return this->pData[i * this->Stride + b];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // доступ к элементу
+const T& TVectorBatch<T, Alloc>::operator()(int b, int i) const
+{
+	if (TDebugBoundsCheck::Enabled && (b < 0 || b >= this->Count || i < 0 || i >= this->Rows))
+		throw out_of_range("Index out of range");
+	return this->pData[i * this->Stride + b];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // копия вектора b
+TVector<T> TVectorBatch<T, Alloc>::Get(int b) const
+{
+	if (b < 0 || b >= this->Count)
+		throw out_of_range("Index out of range");
+	TVector<T> v(this->Rows);
+	for (int i = 0; i < this->Rows; i++)
+	{
+		v[i] = this->pData[i * this->Stride + b];
+	}
+	return v;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // записать вектор b
+void TVectorBatch<T, Alloc>::Set(int b, const TVector<T> &v)
+{
+	if (b < 0 || b >= this->Count)
+		throw out_of_range("Index out of range");
+	if (v.GetSize() != this->Rows) throw - 1;
+	for (int i = 0; i < this->Rows; i++)
+	{
+		this->pData[i * this->Stride + b] = v[v.GetStartIndex() + i];
+	}
+} /*-------------------------------------------------------------------------*/
+
+// Пакет из count верхнетреугольных матриц размера s (упаковка по строкам,
+// как в TMatrix): элемент (i, j) матрицы b - pData[Index(i, j) * Stride + b].
+template <class T, class Alloc = TDefaultAlloc>
+class TMatrixBatch : public TBatchBuffer<T, Alloc>
+{
+protected:
+  int Size; // размер матриц
+
+  static int PackedSize(int n)       { return n * (n + 1) / 2; }
+  int Index(int i, int j) const      { return i * Size - i * (i - 1) / 2 + j - i; }
+  int Chunk() const;                             // число матриц в части пакета
+  template <class F>
+  void ForChunks(F f) const;                     // f(b0, b1) по частям [0, Count)
+  template <int Op>
+  void Combine(const TMatrixBatch &mb, TMatrixBatch &res) const; // res = this op mb
+public:
+  TMatrixBatch(int s, int count);
+
+  int GetSize() const { return Size; }
+  T& operator()(int b, int i, int j);            // элемент (i, j) матрицы b
+  const T& operator()(int b, int i, int j) const;
+  TMatrix<T> Get(int b) const;                   // копия матрицы b
+  template <class A>
+  void Set(int b, const TMatrix<T, A> &mt);      // записать матрицу b
+  bool operator==(const TMatrixBatch &mb) const { return Size == mb.Size && this->Equal(mb); }
+  bool operator!=(const TMatrixBatch &mb) const { return !(*this == mb); }
+
+  // поэлементные операции над парами матриц с одинаковыми номерами
+  TMatrixBatch  operator+(const TMatrixBatch &mb) const;
+  TMatrixBatch  operator-(const TMatrixBatch &mb) const;
+  TMatrixBatch  operator*(const TMatrixBatch &mb) const;
+  TMatrixBatch& operator+=(const TMatrixBatch &mb);
+  TMatrixBatch& operator-=(const TMatrixBatch &mb);
+
+  // решение систем Ux = b для каждой пары (матрица, правая часть)
+  TVectorBatch<T, Alloc> Solve(const TVectorBatch<T, Alloc> &b) const;
+  void SolveInPlace(TVectorBatch<T, Alloc> &b) const; // x записывается в b
+};
+
+template <class T, class Alloc>
+TMatrixBatch<T, Alloc>::TMatrixBatch(int s, int count):
+  TBatchBuffer<T, Alloc>(s >= 0 && s < MAX_MATRIX_SIZE ? PackedSize(s) : 0, count), Size(s)
+{
+	if (s < 0 || s >= MAX_MATRIX_SIZE) throw - 1;
+} /*-------------------------------------------------------------------------*/
+
+// Часть пакета для одного прохода: при умножении часть множителя B и
+// строки A и C умещаются в BATCH_CACHE_BYTES, но не короче BATCH_MIN_CHUNK
+// (каждое ядро обрабатывает часть целиком); граница части кратна строке кэша.
+template <class T, class Alloc>
+int TMatrixBatch<T, Alloc>::Chunk() const
+{
+	int lane = this->Lane();
+	int chunk = BATCH_CACHE_BYTES / ((PackedSize(Size) + 2 * Size + 1) * (int)sizeof(T));
+	if (chunk < BATCH_MIN_CHUNK) chunk = BATCH_MIN_CHUNK;
+	return (chunk + lane - 1) / lane * lane;
+} /*-------------------------------------------------------------------------*/
+
+// Части раздаются потокам пула динамически; ниже GetParallelThreshold()
+// элементов пакета все части выполняет вызывающий поток.
+template <class T, class Alloc>
+template <class F>
+void TMatrixBatch<T, Alloc>::ForChunks(F f) const
+{
+	int chunk = Chunk(), count = this->Count;
+	int parts = (count + chunk - 1) / chunk;
+	auto part = [&f, chunk, count](int p) { f(p * chunk, min((p + 1) * chunk, count)); };
+	if (this->Length() < GetParallelThreshold()) {
+		for (int p = 0; p < parts; p++)
+		{
+			part(p);
+		}
+	}
+	else
+		ParallelTasks(parts, part);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // доступ к элементу
+T& TMatrixBatch<T, Alloc>::operator()(int b, int i, int j)
+{
+	if (TDebugBoundsCheck::Enabled && (b < 0 || b >= this->Count || i < 0 || i > j || j >= Size))
+		throw out_of_range("Index out of range");
+	return this->pData[Index(i, j) * this->Stride + b];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // доступ к элементу
+const T& TMatrixBatch<T, Alloc>::operator()(int b, int i, int j) const
+{
+	if (TDebugBoundsCheck::Enabled && (b < 0 || b >= this->Count || i < 0 || i > j || j >= Size))
+		throw out_of_range("Index out of range");
+	return this->pData[Index(i, j) * this->Stride + b];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // копия матрицы b
+TMatrix<T> TMatrixBatch<T, Alloc>::Get(int b) const
+{
+	if (b < 0 || b >= this->Count)
+		throw out_of_range("Index out of range");
+	TMatrix<T> mt(Size);
+	for (int i = 0; i < Size; i++)
+	{
+		for (int j = i; j < Size; j++)
+		{
+			mt(i, j) = this->pData[Index(i, j) * this->Stride + b];
+		}
+	}
+	return mt;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // записать матрицу b
+template <class A>
+void TMatrixBatch<T, Alloc>::Set(int b, const TMatrix<T, A> &mt)
+{
+	if (b < 0 || b >= this->Count)
+		throw out_of_range("Index out of range");
+	if (mt.GetSize() != Size) throw - 1;
+	for (int i = 0; i < Size; i++)
+	{
+		for (int j = i; j < Size; j++)
+		{
+			this->pData[Index(i, j) * this->Stride + b] = mt(i, j);
+		}
+	}
+} /*-------------------------------------------------------------------------*/
+
+// Буфер пакета непрерывен: сложение и вычитание - одно ядро по всем
+// элементам всех матриц (c может совпадать с a).
+template <class T, class Alloc>
+template <int Op>
+void TMatrixBatch<T, Alloc>::Combine(const TMatrixBatch &mb, TMatrixBatch &res) const
+{
+	if (Size != mb.Size || this->Count != mb.Count) throw - 1;
+	const T *a = this->pData, *b = mb.pData;
+	T *c = res.pData;
+	ParallelRange(this->Length(), this->Lane(),
+	  [a, b, c](int from, int to) { SimdBinary<Op>(a + from, b + from, c + from, to - from); });
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // сложение
+TMatrixBatch<T, Alloc> TMatrixBatch<T, Alloc>::operator+(const TMatrixBatch &mb) const
+{
+	TMatrixBatch tmp(Size, this->Count);
+	Combine<SIMD_ADD>(mb, tmp);
+	return tmp;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // вычитание
+TMatrixBatch<T, Alloc> TMatrixBatch<T, Alloc>::operator-(const TMatrixBatch &mb) const
+{
+	TMatrixBatch tmp(Size, this->Count);
+	Combine<SIMD_SUB>(mb, tmp);
+	return tmp;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // прибавить пакет на месте
+TMatrixBatch<T, Alloc>& TMatrixBatch<T, Alloc>::operator+=(const TMatrixBatch &mb)
+{
+	Combine<SIMD_ADD>(mb, *this);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // вычесть пакет на месте
+TMatrixBatch<T, Alloc>& TMatrixBatch<T, Alloc>::operator-=(const TMatrixBatch &mb)
+{
+	Combine<SIMD_SUB>(mb, *this);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // умножение
+TMatrixBatch<T, Alloc> TMatrixBatch<T, Alloc>::operator*(const TMatrixBatch &mb) const
+{
+	// C[i][j] += A[i][k] * B[k][j] по i <= k <= j, как в TMatrix::operator*,
+	// только каждое умножение-сложение - ядро SimdMulAdd по части пакета.
+	// Строка k матрицы B упакована подряд, поэтому B[k][j] для j = k..n-1
+	// идут с шагом Stride.
+	if (Size != mb.Size || this->Count != mb.Count) throw - 1;
+	TMatrixBatch tmp(Size, this->Count);
+	const int n = Size, stride = this->Stride;
+	const T *pa = this->pData, *pb = mb.pData;
+	T *pc = tmp.pData;
+	ForChunks([this, n, stride, pa, pb, pc](int b0, int b1) {
+		for (int i = 0; i < n; i++)
+		{
+			for (int k = i; k < n; k++)
+			{
+				const T *a = pa + Index(i, k) * stride + b0;
+				const T *b = pb + Index(k, k) * stride + b0;
+				T *c = pc + Index(i, k) * stride + b0;
+				for (int j = k; j < n; j++, b += stride, c += stride)
+				{
+					SimdMulAdd(a, b, c, b1 - b0);
+				}
+			}
+		}
+	});
+	return tmp;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // решение систем
+TVectorBatch<T, Alloc> TMatrixBatch<T, Alloc>::Solve(const TVectorBatch<T, Alloc> &b) const
+{
+	TVectorBatch<T, Alloc> x(b);
+	SolveInPlace(x);
+	return x;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // решение систем на месте
+void TMatrixBatch<T, Alloc>::SolveInPlace(TVectorBatch<T, Alloc> &vb) const
+{
+	// Обратная подстановка одновременно для всех систем части пакета:
+	// s = сумма U[i][j] * x[j] по j > i накапливается ядром SimdMulAdd,
+	// затем x[i] = (x[i] - s) / U[i][i].
+	if (vb.GetSize() != Size || vb.GetCount() != this->Count) throw - 1;
+	const int n = Size, stride = this->Stride;
+	const T *pu = this->pData;
+	T *px = vb.pData;
+	ForChunks([this, n, stride, pu, px](int b0, int b1) {
+		int len = b1 - b0;
+		TVector<T> acc(len, 0, ZERO_INIT);
+		T *s = &acc[0];
+		for (int i = n - 1; i >= 0; i--)
+		{
+			const T *u = pu + Index(i, i) * stride + b0;
+			for (int j = i + 1; j < n; j++)
+			{
+				SimdMulAdd(u + (j - i) * stride, px + j * stride + b0, s, len);
+			}
+			T *x = px + i * stride + b0;
+			for (int b = 0; b < len; b++)
+			{
+				if (u[b] == T()) throw - 1; // вырожденная матрица
+				x[b] = (x[b] - s[b]) / u[b];
+				s[b] = T();
+			}
+		}
+	});
+} /*-------------------------------------------------------------------------*/
+
+#endif
@@ -8,330 +8,2183 @@
 #ifndef __TMATRIX_H__
 #define __TMATRIX_H__
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "utalloc.h"
+#include "utsimd.h"
+#include "utparallel.h"
 
 using namespace std;
 
 const int MAX_VECTOR_SIZE = 100000000;
 const int MAX_MATRIX_SIZE = 10000;
+const int MATRIX_BLOCK_SIZE = 64; // сторона блока при умножении матриц и решении систем
+const int MATRIX_PANEL_DEPTH = 256; // глубина (по k) упакованных панелей при умножении
+
+// порядок обхода при решении треугольной системы
+enum TSolveOrder {
+  SOLVE_ROWS,   // по строкам: блок сначала учитывает уже найденные x, затем решается
+  SOLVE_COLUMNS // по столбцам: решённый блок сразу вычитается из строк выше
+};
+
+// Конструирование по умолчанию n элементов в сырой памяти p. Для
+// тривиальных типов, как и у new T[n], память не инициализируется: её
+// всё равно сразу перезаписывают (результаты +, -, копии).
+template <class T>
+void DefaultConstruct(T *, int, true_type)
+{
+} /*-------------------------------------------------------------------------*/
+
+template <class T>
+void DefaultConstruct(T *p, int n, false_type)
+{
+	int k = 0;
+	try {
+		for (; k < n; k++)
+		{
+			new (p + k) T;
+		}
+	}
+	catch (...) {
+		while (k > 0)
+			p[--k].~T();
+		throw;
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class T>
+void DefaultConstruct(T *p, int n)
+{
+	DefaultConstruct(p, n, typename is_trivially_default_constructible<T>::type());
+} /*-------------------------------------------------------------------------*/
+
+// выровненный массив из n элементов от распределителя Alloc (замена new T[n])
+template <class Alloc, class T>
+T* AlignedNew(int n)
+{
+	T *p = static_cast<T*>(Alloc::Allocate(n * sizeof(T)));
+	try {
+		DefaultConstruct(p, n);
+	}
+	catch (...) {
+		Alloc::Free(p, n * sizeof(T));
+		throw;
+	}
+	return p;
+} /*-------------------------------------------------------------------------*/
+
+// выровненный массив из n копий val
+template <class Alloc, class T>
+T* AlignedNewFill(int n, const T &val)
+{
+	T *p = static_cast<T*>(Alloc::Allocate(n * sizeof(T)));
+	try {
+		uninitialized_fill_n(p, n, val);
+	}
+	catch (...) {
+		Alloc::Free(p, n * sizeof(T));
+		throw;
+	}
+	return p;
+} /*-------------------------------------------------------------------------*/
+
+// выровненный массив из n нулевых элементов: у арифметических типов нулевые
+// биты и есть ноль, остальные типы инициализируются значением T()
+template <class Alloc, class T>
+T* AlignedNewZero(int n, true_type)
+{
+	return static_cast<T*>(Alloc::AllocateZero(n * sizeof(T)));
+} /*-------------------------------------------------------------------------*/
+
+template <class Alloc, class T>
+T* AlignedNewZero(int n, false_type)
+{
+	return AlignedNewFill<Alloc>(n, T());
+} /*-------------------------------------------------------------------------*/
+
+template <class Alloc, class T>
+T* AlignedNewZero(int n)
+{
+	return AlignedNewZero<Alloc, T>(n, typename is_arithmetic<T>::type());
+} /*-------------------------------------------------------------------------*/
+
+// освобождение массива AlignedNew (замена delete[])
+template <class Alloc, class T>
+void AlignedDelete(T *p, int n)
+{
+	if (!p) return;
+	for (int k = 0; k < n; k++)
+	{
+		p[k].~T();
+	}
+	Alloc::Free(p, n * sizeof(T));
+} /*-------------------------------------------------------------------------*/
+
+// признак конструктора вектора, заполняющего его нулями
+struct TZeroInit {};
+const TZeroInit ZERO_INIT = TZeroInit();
+
+template <class T, class Alloc = TDefaultAlloc> class TMatrix;
+
+// Выражения над векторами
+// Операторы +, - и умножение на скаляр не вычисляют результат сразу, а
+// строят дерево выражения; оно вычисляется одним циклом при присваивании
+// вектору или конструировании вектора. Выражение хранит ссылки на
+// векторы-операнды и должно использоваться в пределах одного выражения
+// (не сохранять в auto).
+template <class E>
+class TVecExpr
+{
+public:
+  const E& Self() const { return static_cast<const E&>(*this); }
+};
+
+// способ хранения операнда в узле: векторы - по ссылке, узлы - по значению
+template <class E> struct TExprStore { typedef const E& type; };
+
+struct TOpAdd
+{
+  static const int Simd = SIMD_ADD;
+  template <class A, class B>
+  static auto Apply(const A &a, const B &b) -> decltype(a + b) { return a + b; }
+};
+
+struct TOpSub
+{
+  static const int Simd = SIMD_SUB;
+  template <class A, class B>
+  static auto Apply(const A &a, const B &b) -> decltype(a - b) { return a - b; }
+};
+
+struct TOpMul
+{
+  static const int Simd = SIMD_MUL;
+  template <class A, class B>
+  static auto Apply(const A &a, const B &b) -> decltype(a * b) { return a * b; }
+};
+
+// поэлементная операция над двумя векторами
+template <class L, class R, class Op>
+class TVecBinary : public TVecExpr<TVecBinary<L, R, Op> >
+{
+  typename TExprStore<L>::type Left;
+  typename TExprStore<R>::type Right;
+public:
+  typedef typename L::ValueType ValueType;
+
+  TVecBinary(const L &l, const R &r): Left(l), Right(r)
+  {
+    if (Left.GetSize() != Right.GetSize()) throw - 1;
+  }
+  const L& GetLeft() const  { return Left;                 }
+  const R& GetRight() const { return Right;                }
+  int GetSize() const       { return Left.GetSize();       }
+  int GetStartIndex() const { return Left.GetStartIndex(); }
+  auto Elem(int k) const -> decltype(Op::Apply(Left.Elem(k), Right.Elem(k)))
+  {
+    return Op::Apply(Left.Elem(k), Right.Elem(k));
+  }
+};
+
+// операция над вектором и скаляром
+template <class E, class Op>
+class TVecScalar : public TVecExpr<TVecScalar<E, Op> >
+{
+public:
+  typedef typename E::ValueType ValueType;
+private:
+  typename TExprStore<E>::type Expr;
+  ValueType Val;
+public:
+  TVecScalar(const E &e, const ValueType &val): Expr(e), Val(val) {}
+  const E& GetExpr() const  { return Expr;                 }
+  const ValueType& GetVal() const { return Val;            }
+  int GetSize() const       { return Expr.GetSize();       }
+  int GetStartIndex() const { return Expr.GetStartIndex(); }
+  auto Elem(int k) const -> decltype(Op::Apply(Expr.Elem(k), Val))
+  {
+    return Op::Apply(Expr.Elem(k), Val);
+  }
+};
+
+template <class L, class R, class Op>
+struct TExprStore<TVecBinary<L, R, Op> > { typedef TVecBinary<L, R, Op> type; };
+
+template <class E, class Op>
+struct TExprStore<TVecScalar<E, Op> > { typedef TVecScalar<E, Op> type; };
+
+template <class L, class R> // сложение
+TVecBinary<L, R, TOpAdd> operator+(const TVecExpr<L> &l, const TVecExpr<R> &r)
+{
+	return TVecBinary<L, R, TOpAdd>(l.Self(), r.Self());
+} /*-------------------------------------------------------------------------*/
+
+template <class L, class R> // вычитание
+TVecBinary<L, R, TOpSub> operator-(const TVecExpr<L> &l, const TVecExpr<R> &r)
+{
+	return TVecBinary<L, R, TOpSub>(l.Self(), r.Self());
+} /*-------------------------------------------------------------------------*/
+
+template <class E> // прибавить скаляр
+TVecScalar<E, TOpAdd> operator+(const TVecExpr<E> &e, const typename E::ValueType &val)
+{
+	return TVecScalar<E, TOpAdd>(e.Self(), val);
+} /*-------------------------------------------------------------------------*/
+
+template <class E> // вычесть скаляр
+TVecScalar<E, TOpSub> operator-(const TVecExpr<E> &e, const typename E::ValueType &val)
+{
+	return TVecScalar<E, TOpSub>(e.Self(), val);
+} /*-------------------------------------------------------------------------*/
+
+template <class E> // умножить на скаляр
+TVecScalar<E, TOpMul> operator*(const TVecExpr<E> &e, const typename E::ValueType &val)
+{
+	return TVecScalar<E, TOpMul>(e.Self(), val);
+} /*-------------------------------------------------------------------------*/
+
+template <class L, class R> // сравнение
+bool operator==(const TVecExpr<L> &l, const TVecExpr<R> &r)
+{
+	const L &a = l.Self();
+	const R &b = r.Self();
+	if (a.GetSize() != b.GetSize() || a.GetStartIndex() != b.GetStartIndex())
+		return false;
+	for (int k = 0; k < a.GetSize(); k++)
+	{
+		if (a.Elem(k) != b.Elem(k)) return false;
+	}
+	return true;
+} /*-------------------------------------------------------------------------*/
+
+template <class L, class R> // сравнение
+bool operator!=(const TVecExpr<L> &l, const TVecExpr<R> &r)
+{
+	return !(l == r);
+} /*-------------------------------------------------------------------------*/
 
 // Шаблон вектора
+// Проверка индекса в TVector::operator[] (параметр шаблона вектора).
+// at() проверяет индекс всегда, независимо от выбранной политики.
+struct TBoundsCheck      { static const bool Enabled = true;  }; // всегда
+struct TNoBoundsCheck    { static const bool Enabled = false; }; // никогда
+struct TDebugBoundsCheck                                          // только без NDEBUG
+{
+#ifdef NDEBUG
+  static const bool Enabled = false;
+#else
+  static const bool Enabled = true;
+#endif
+};
+
+// Память буфера выделяет распределитель Alloc (параметр шаблона, см. utalloc.h).
+template <class T, class Check = TBoundsCheck, class Alloc = TDefaultAlloc> class TVector;
+template <class T> class TVectorView;
+template <class T> class TMatBlock;
+
+// Плотные операнды выражений - векторы и представления (TVectorView):
+// элементы лежат подряд, Data - адрес первого из них.
+template <class E> struct TDense { static const bool Value = false; };
+
+template <class T, class Check, class Alloc>
+struct TDense<TVector<T, Check, Alloc> >
+{
+  static const bool Value = true;
+  static const T* Data(const TVector<T, Check, Alloc> &v) { return v.pVector; }
+};
+
+template <class T>
+struct TDense<TVectorView<T> >
+{
+  static const bool Value = true;
+  static const T* Data(const TVectorView<T> &v) { return v.pData; }
+};
+
+// Вычисление элементов выражения с номерами [from, to) в память dst
+// (dst[k] = ex.Elem(k)). Узлы из одной операции над плотными векторами
+// (матрицами) идут в векторизованные ядра utsimd.h, прочие деревья вычисляются общим
+// циклом по Elem. Диапазон позволяет делить вычисление между потоками.
+template <class E, class T>
+void EvalExpr(const E &ex, T *dst, int from, int to)
+{
+	for (int k = from; k < to; k++)
+	{
+		dst[k] = ex.Elem(k);
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class L, class R, class Op, class T>
+typename enable_if<TDense<L>::Value && TDense<R>::Value && is_same<typename L::ValueType, T>::value &&
+  is_same<typename R::ValueType, T>::value>::type
+EvalExpr(const TVecBinary<L, R, Op> &ex, T *dst, int from, int to)
+{
+	if (from < to)
+		SimdBinary<Op::Simd>(TDense<L>::Data(ex.GetLeft()) + from, TDense<R>::Data(ex.GetRight()) + from,
+		  dst + from, to - from);
+} /*-------------------------------------------------------------------------*/
+
+template <class E, class Op, class T>
+typename enable_if<TDense<E>::Value && is_same<typename E::ValueType, T>::value>::type
+EvalExpr(const TVecScalar<E, Op> &ex, T *dst, int from, int to)
+{
+	if (from < to)
+		SimdScalar<Op::Simd>(TDense<E>::Data(ex.GetExpr()) + from, ex.GetVal(), dst + from, to - from);
+} /*-------------------------------------------------------------------------*/
+
+// Вычисление выражения в dst (n элементов) частями в пуле потоков
+// (utparallel.h); границы частей кратны строке кэша.
+template <class E, class T>
+void ParallelEvalExpr(const E &ex, T *dst, int n)
+{
+	ParallelRange(n, int(VECTOR_ALIGNMENT / sizeof(T)),
+	  [&ex, dst](int from, int to) { EvalExpr(ex, dst, from, to); });
+} /*-------------------------------------------------------------------------*/
+
+// Представление отрезка вектора или строки матрицы (TVector::View,
+// TMatrix::Row, TMatBlock::Row): адрес чужих элементов, размер и индекс
+// первого элемента, совпадающий с индексом в исходном векторе.
+// Представление не владеет памятью и не должно переживать её владельца.
+// Копия представления ссылается на те же элементы, а присваивание
+// представлению записывает элементы (размеры должны совпадать). TVector,
+// построенный или присвоенный из представления, получает копию элементов.
+// TVectorView<const T> - представление только для чтения; в него
+// превращаются изменяемое представление и любой вектор с элементами T.
 template <class T>
-class TVector
+class TVectorView : public TVecExpr<TVectorView<T> >
+{
+  T *pData;
+  int Size;       // размер представления
+  int StartIndex; // индекс первого элемента
+
+  template <class> friend class TVectorView;
+  template <class> friend struct TDense;
+  template <class> friend class TMatBlock;
+  template <class, class> friend class TMatrix;
+public:
+  typedef typename remove_const<T>::type ValueType;
+
+  TVectorView(T *p, int s, int si): pData(p), Size(s), StartIndex(si) {}
+  TVectorView(const TVectorView &v) = default;
+  template <class U, class = typename enable_if<is_same<const U, T>::value>::type>
+  TVectorView(const TVectorView<U> &v): pData(v.pData), Size(v.Size), StartIndex(v.StartIndex) {}
+  // весь вектор v
+  template <class C, class A, class U = T, class = typename enable_if<!is_const<U>::value>::type>
+  TVectorView(TVector<ValueType, C, A> &v): TVectorView(v.View(v.GetStartIndex(), v.GetStartIndex() + v.GetSize())) {}
+  template <class C, class A, class U = T, class = typename enable_if<is_const<U>::value>::type>
+  TVectorView(const TVector<ValueType, C, A> &v): TVectorView(v.View(v.GetStartIndex(), v.GetStartIndex() + v.GetSize())) {}
+  int GetSize() const       { return Size;       } // размер представления
+  int GetStartIndex() const { return StartIndex; } // индекс первого элемента
+  const ValueType& Elem(int k) const { return pData[k]; } // элемент по смещению k от начала
+  T& operator[](int pos) const;                   // доступ с проверкой индекса
+  TVectorView View(int from, int to) const;       // отрезок [from, to) представления
+  TVectorView& operator=(const TVectorView &v);   // запись элементов v
+  template <class E>
+  TVectorView& operator=(const TVecExpr<E> &e);   // запись элементов выражения
+
+  // операции на месте
+  TVectorView& operator+=(const ValueType &val);  // прибавить скаляр
+  TVectorView& operator-=(const ValueType &val);  // вычесть скаляр
+  TVectorView& operator*=(const ValueType &val);  // умножить на скаляр
+  template <class E>
+  TVectorView& operator+=(const TVecExpr<E> &e);  // прибавить выражение
+  template <class E>
+  TVectorView& operator-=(const TVecExpr<E> &e);  // вычесть выражение
+
+  friend ostream& operator<<(ostream &out, const TVectorView &v)
+  {
+    for (int i = 0; i < v.Size; i++)
+      out << v.pData[i] << ' ';
+    return out;
+  }
+};
+
+template <class T> // представления хранятся в узлах выражений по значению
+struct TExprStore<TVectorView<T> > { typedef TVectorView<T> type; };
+
+template <class T> // доступ
+T& TVectorView<T>::operator[](int pos) const
+{
+	int k = pos - StartIndex;
+	if ((unsigned)k >= (unsigned)Size)
+		throw out_of_range("Index out of range");
+	return pData[k];
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // отрезок представления
+TVectorView<T> TVectorView<T>::View(int from, int to) const
+{
+	if (from < StartIndex || from > to || to > StartIndex + Size)
+		throw out_of_range("Index out of range");
+	return TVectorView(pData + from - StartIndex, to - from, from);
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // запись элементов представления
+TVectorView<T>& TVectorView<T>::operator=(const TVectorView &v)
+{
+	return *this = static_cast<const TVecExpr<TVectorView>&>(v);
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // запись элементов выражения
+template <class E>
+TVectorView<T>& TVectorView<T>::operator=(const TVecExpr<E> &e)
+{
+	static_assert(!is_const<T>::value, "read-only view cannot be assigned");
+	const E &ex = e.Self();
+	if (Size != ex.GetSize()) throw - 1; // размер представления менять нельзя
+	ParallelEvalExpr(ex, pData, Size);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // прибавить скаляр на месте
+TVectorView<T>& TVectorView<T>::operator+=(const ValueType &val)
+{
+	return *this = *this + val;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // вычесть скаляр на месте
+TVectorView<T>& TVectorView<T>::operator-=(const ValueType &val)
+{
+	return *this = *this - val;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // умножить на скаляр на месте
+TVectorView<T>& TVectorView<T>::operator*=(const ValueType &val)
+{
+	return *this = *this * val;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // прибавить выражение на месте
+template <class E>
+TVectorView<T>& TVectorView<T>::operator+=(const TVecExpr<E> &e)
+{
+	return *this = *this + e;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // вычесть выражение на месте
+template <class E>
+TVectorView<T>& TVectorView<T>::operator-=(const TVecExpr<E> &e)
+{
+	return *this = *this - e;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc>
+class TVector : public TVecExpr<TVector<T, Check, Alloc> >,
+  protected TLocalBuffer<T, Alloc::LocalSize>
+{
+protected:
+  T *pVector;
+  int Size;       // размер вектора
+  int Capacity;   // число элементов в буфере pVector (не меньше Size)
+  int StartIndex; // индекс первого элемента вектора
+  bool Owner;     // владеет ли вектор памятью pVector
+
+  // вектор-представление чужой памяти (строка упакованной матрицы)
+  TVector(T *p, int s, int si): pVector(p), Size(s), Capacity(s), StartIndex(si), Owner(false) {}
+  void Reallocate(int cap);                 // перенос элементов в буфер из cap элементов
+  void Detach();                            // собственная копия разделяемого буфера
+  void Seal();                              // Detach и запрет разделения буфера (наружу уходит изменяемая ссылка)
+  void Drop();                              // отказ от буфера (освобождение последней ссылки)
+  bool IsLocal() const { return Alloc::LocalSize > 0 && pVector == this->LocalData(); }
+  T* NewBuffer(int &cap);                   // буфер не меньше cap элементов, cap - его ёмкость
+  void FreeBuffer(T *p, int cap);           // освобождение буфера NewBuffer
+  void MoveLocal(TVector &v);               // перенос элементов малого буфера v в свой
+
+  template <class, class> friend class TMatrix;
+  template <class> friend class TMatBlock;
+  template <class> friend struct TDense;
+public:
+  typedef T ValueType;
+  // перемещение вектора из малого буфера конструирует и присваивает элементы
+  static const bool NothrowMove = Alloc::LocalSize == 0 ||
+    (is_nothrow_default_constructible<T>::value && is_nothrow_move_assignable<T>::value);
+
+  TVector(int s = 10, int si = 0);
+  TVector(int s, int si, const T &val);     // все элементы равны val
+  TVector(int s, int si, TZeroInit);        // все элементы нулевые
+  TVector(const TVector &v);                // конструктор копирования
+  TVector(TVector &&v) noexcept(NothrowMove); // конструктор перемещения
+  template <class E, class = typename enable_if<is_same<typename E::ValueType, T>::value>::type>
+  TVector(const TVecExpr<E> &e);            // вычисление выражения
+  ~TVector();
+  int GetSize() const      { return Size;       } // размер вектора
+  int GetStartIndex() const{ return StartIndex; } // индекс первого элемента
+  int GetCapacity() const  { return Capacity;   } // ёмкость буфера
+  void reserve(int cap);              // ёмкость не меньше cap
+  void shrink_to_fit();               // ёмкость равна размеру
+  const T& Elem(int k) const { return pVector[k]; } // элемент по смещению k от начала
+  // представление элементов с индексами [from, to) без копирования (см.
+  // TVectorView); разделяемый буфер (TCowAlloc) представление и
+  // неконстантные operator[], at отделяют от копий и запечатывают:
+  // следующие копии копируют элементы
+  TVectorView<T> View(int from, int to);
+  TVectorView<const T> View(int from, int to) const;
+  T& operator[](int pos);             // доступ (проверка по политике Check)
+  const T& operator[](int pos) const;
+  T& at(int pos);                     // доступ с проверкой индекса
+  const T& at(int pos) const;
+  bool operator==(const TVector &v) const;  // сравнение
+  bool operator!=(const TVector &v) const;  // сравнение
+  template <class E>
+  bool operator==(const TVecExpr<E> &e) const; // сравнение с выражением
+  template <class E>
+  bool operator!=(const TVecExpr<E> &e) const; // сравнение с выражением
+  TVector& operator=(const TVector &v);     // присваивание
+  TVector& operator=(TVector &&v);          // присваивание перемещением
+  template <class E>
+  TVector& operator=(const TVecExpr<E> &e); // присваивание выражения
+
+  // скалярные операции (векторные + и - - свободные операторы над выражениями)
+  TVecScalar<TVector, TOpAdd> operator+(const T &val) const; // прибавить скаляр
+  TVecScalar<TVector, TOpSub> operator-(const T &val) const; // вычесть скаляр
+  TVecScalar<TVector, TOpMul> operator*(const T &val) const; // умножить на скаляр
+
+  // векторные операции
+  T  operator*(const TVector &v) const; // скалярное произведение
+
+  // операции на месте (память вектора не перевыделяется)
+  TVector& operator+=(const T &val);        // прибавить скаляр
+  TVector& operator-=(const T &val);        // вычесть скаляр
+  TVector& operator*=(const T &val);        // умножить на скаляр
+  TVector& operator+=(const TVector &v);    // прибавить вектор
+  TVector& operator-=(const TVector &v);    // вычесть вектор
+  template <class E>
+  TVector& operator+=(const TVecExpr<E> &e); // прибавить выражение
+  template <class E>
+  TVector& operator-=(const TVecExpr<E> &e); // вычесть выражение
+
+  // ввод-вывод
+  friend istream& operator>>(istream &in, TVector &v)
+  {
+    if (Alloc::Shared) v.Detach();
+    for (int i = 0; i < v.Size; i++)
+      in >> v.pVector[i];
+    return in;
+  }
+  friend ostream& operator<<(ostream &out, const TVector &v)
+  {
+    for (int i = 0; i < v.Size; i++)
+      out << v.pVector[i] << ' ';
+    return out;
+  }
+};
+
+template <class T, class Check, class Alloc>
+TVector<T, Check, Alloc>::TVector(int s, int si)
+{
+	//Новый код
+	if (s<0 || s > MAX_VECTOR_SIZE || si < 0)
+		throw -1;
+	Size = s;
+	Capacity = s;
+	StartIndex = si;
+	Owner = true;
+	pVector = NewBuffer(Capacity);
+
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // заполнение значением
+TVector<T, Check, Alloc>::TVector(int s, int si, const T &val)
+{
+	if (s<0 || s > MAX_VECTOR_SIZE || si < 0)
+		throw -1;
+	Size = s;
+	Capacity = s;
+	StartIndex = si;
+	Owner = true;
+	if (s > Alloc::LocalSize) {
+		pVector = AlignedNewFill<Alloc>(Size, val);
+		return;
+	}
+	pVector = NewBuffer(Capacity);
+	fill(pVector, pVector + Size, val);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // заполнение нулями
+TVector<T, Check, Alloc>::TVector(int s, int si, TZeroInit)
+{
+	if (s<0 || s > MAX_VECTOR_SIZE || si < 0)
+		throw -1;
+	Size = s;
+	Capacity = s;
+	StartIndex = si;
+	Owner = true;
+	if (s > Alloc::LocalSize) {
+		pVector = AlignedNewZero<Alloc, T>(Size);
+		return;
+	}
+	pVector = NewBuffer(Capacity);
+	fill(pVector, pVector + Size, T());
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> //конструктор копирования
+TVector<T, Check, Alloc>::TVector(const TVector<T, Check, Alloc> &v)
+{
+	Size = v.Size;
+	StartIndex = v.StartIndex;
+	Owner = true;
+	if (Alloc::Shared && v.Owner && v.pVector && Alloc::Shareable(v.pVector)) { // копия ссылается на тот же буфер
+		pVector = v.pVector;
+		Capacity = v.Capacity;
+		Alloc::AddRef(pVector);
+		return;
+	}
+	Capacity = v.Size;
+	pVector = NewBuffer(Capacity);
+	for (int i = 0; i < Size; i++)
+	{
+		pVector[i] = v.pVector[i];
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // конструктор перемещения
+TVector<T, Check, Alloc>::TVector(TVector<T, Check, Alloc> &&v) noexcept(NothrowMove)
+{
+	pVector = v.pVector;
+	Size = v.Size;
+	Capacity = v.Capacity;
+	StartIndex = v.StartIndex;
+	Owner = v.Owner;
+	if (v.IsLocal()) { // малый буфер остаётся у v, элементы переносятся
+		MoveLocal(v);
+		v.Size = 0;
+	}
+	else if (Owner) { // представление продолжает ссылаться на ту же память
+		v.pVector = 0;
+		v.Size = 0;
+		v.Capacity = 0;
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // вычисление выражения одним проходом
+template <class E, class>
+TVector<T, Check, Alloc>::TVector(const TVecExpr<E> &e)
+{
+	const E &ex = e.Self();
+	Size = ex.GetSize();
+	Capacity = Size;
+	StartIndex = ex.GetStartIndex();
+	Owner = true;
+	pVector = NewBuffer(Capacity);
+	ParallelEvalExpr(ex, pVector, Size);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc>
+TVector<T, Check, Alloc>::~TVector()
+{
+	if (Owner)
+		Drop();
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // отказ от буфера
+void TVector<T, Check, Alloc>::Drop()
+{
+	if (pVector && Alloc::Release(pVector))
+		FreeBuffer(pVector, Capacity);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // новый буфер
+T* TVector<T, Check, Alloc>::NewBuffer(int &cap)
+{
+	// короткий вектор размещается в малом буфере внутри объекта, все
+	// LocalSize элементов которого сразу сконструированы
+	if (cap > Alloc::LocalSize)
+		return AlignedNew<Alloc, T>(cap);
+	cap = Alloc::LocalSize;
+	T *p = this->LocalData();
+	DefaultConstruct(p, cap);
+	return p;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // освобождение буфера
+void TVector<T, Check, Alloc>::FreeBuffer(T *p, int cap)
+{
+	if (Alloc::LocalSize > 0 && p == this->LocalData()) {
+		for (int k = 0; k < cap; k++)
+		{
+			p[k].~T();
+		}
+		return;
+	}
+	AlignedDelete<Alloc>(p, cap);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // перенос элементов малого буфера
+void TVector<T, Check, Alloc>::MoveLocal(TVector &v)
+{
+	// исключение элемента выходит из конструктора перемещения, только если
+	// он не noexcept (см. NothrowMove)
+	pVector = this->LocalData();
+	DefaultConstruct(pVector, Alloc::LocalSize);
+	try {
+		for (int i = 0; i < Size; i++)
+		{
+			pVector[i] = std::move(v.pVector[i]);
+		}
+	}
+	catch (...) {
+		FreeBuffer(pVector, Alloc::LocalSize);
+		throw;
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // отделение от разделяемого буфера
+void TVector<T, Check, Alloc>::Detach()
+{
+	if (!Alloc::Shared || !Owner || !pVector || Alloc::Unique(pVector)) return;
+	int cap = Size;
+	T *p = NewBuffer(cap);
+	try {
+		for (int i = 0; i < Size; i++)
+		{
+			p[i] = pVector[i];
+		}
+	}
+	catch (...) {
+		FreeBuffer(p, cap);
+		throw;
+	}
+	Drop();
+	pVector = p;
+	Capacity = cap;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // запрет разделения буфера
+void TVector<T, Check, Alloc>::Seal()
+{
+	if (!Alloc::Shared || !Owner || !pVector) return;
+	Detach();
+	Alloc::Seal(pVector);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // перенос элементов в новый буфер
+void TVector<T, Check, Alloc>::Reallocate(int cap)
+{
+	if (IsLocal() && cap <= Alloc::LocalSize) return; // уже в малом буфере
+	T *p = NewBuffer(cap);
+	bool unique = !pVector || Alloc::Unique(pVector); // из общего буфера - только копировать
+	try {
+		for (int i = 0; i < Size; i++)
+		{
+			if (unique)
+				p[i] = std::move(pVector[i]);
+			else
+				p[i] = pVector[i];
+		}
+	}
+	catch (...) {
+		FreeBuffer(p, cap);
+		throw;
+	}
+	Drop();
+	pVector = p;
+	Capacity = cap;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // резервирование памяти
+void TVector<T, Check, Alloc>::reserve(int cap)
+{
+	if (cap < 0 || cap > MAX_VECTOR_SIZE) throw - 1;
+	if (cap <= Capacity) return;
+	if (!Owner) throw - 1; // буфер представления расширить нельзя
+	Reallocate(cap);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // освобождение лишней памяти
+void TVector<T, Check, Alloc>::shrink_to_fit()
+{
+	if (Owner && Capacity > Size)
+		Reallocate(Size);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // представление отрезка
+TVectorView<T> TVector<T, Check, Alloc>::View(int from, int to)
+{
+	if (from < StartIndex || from > to || to > StartIndex + Size)
+		throw out_of_range("Index out of range");
+	if (Alloc::Shared) Seal(); // запись через представление изменила бы копии
+	return TVectorView<T>(pVector + from - StartIndex, to - from, from);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // представление отрезка
+TVectorView<const T> TVector<T, Check, Alloc>::View(int from, int to) const
+{
+	if (from < StartIndex || from > to || to > StartIndex + Size)
+		throw out_of_range("Index out of range");
+	// Представление должно видеть запись в сам вектор, а не в буфер копии:
+	// буфер отделяется и запечатывается. Значение вектора при этом не
+	// меняется, меняется только владение буфером.
+	if (Alloc::Shared) const_cast<TVector*>(this)->Seal();
+	return TVectorView<const T>(pVector + from - StartIndex, to - from, from);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // доступ
+T& TVector<T, Check, Alloc>::operator[](int ind)
+{
+	int k = ind - StartIndex; // учесть startIndex
+	if (Check::Enabled && (unsigned)k >= (unsigned)Size)
+		throw out_of_range("Index out of range");
+	if (Alloc::Shared) Seal(); // запись по ссылке изменила бы будущие копии
+	return pVector[k];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // доступ
+const T& TVector<T, Check, Alloc>::operator[](int ind) const
+{
+	int k = ind - StartIndex;
+	if (Check::Enabled && (unsigned)k >= (unsigned)Size)
+		throw out_of_range("Index out of range");
+	return pVector[k];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // доступ с проверкой
+T& TVector<T, Check, Alloc>::at(int ind)
+{
+	int k = ind - StartIndex;
+	if ((unsigned)k >= (unsigned)Size)
+		throw out_of_range("Index out of range");
+	if (Alloc::Shared) Seal(); // запись по ссылке изменила бы будущие копии
+	return pVector[k];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // доступ с проверкой
+const T& TVector<T, Check, Alloc>::at(int ind) const
+{
+	int k = ind - StartIndex;
+	if ((unsigned)k >= (unsigned)Size)
+		throw out_of_range("Index out of range");
+	return pVector[k];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // сравнение
+bool TVector<T, Check, Alloc>::operator==(const TVector &v) const
+{
+	if (Size != v.Size || StartIndex != v.StartIndex) return false;
+
+	for (int i = 0; i < Size; i++)
+	{
+		if (pVector[i] != v.pVector[i]) return false;
+	}
+	return true;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // сравнение
+bool TVector<T, Check, Alloc>::operator!=(const TVector &v) const
+{
+	return !(*this == v);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // сравнение с выражением
+template <class E>
+bool TVector<T, Check, Alloc>::operator==(const TVecExpr<E> &e) const
+{
+	return static_cast<const TVecExpr<TVector>&>(*this) == e;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // сравнение с выражением
+template <class E>
+bool TVector<T, Check, Alloc>::operator!=(const TVecExpr<E> &e) const
+{
+	return !(*this == e);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // присваивание
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator=(const TVector &v)
+{
+	if (this == &v) return *this;
+	// буфер v разделяется, если ни на него, ни на буфер *this нет представлений
+	if (Alloc::Shared && Owner && v.Owner && v.pVector && Alloc::Shareable(v.pVector) &&
+	  (!pVector || Alloc::Shareable(pVector))) {
+		Alloc::AddRef(v.pVector);
+		Drop();
+		pVector = v.pVector;
+		Size = v.Size;
+		Capacity = v.Capacity;
+		StartIndex = v.StartIndex;
+		return *this;
+	}
+	if (Size != v.Size) {
+		if (!Owner) throw - 1; // у представления размер менять нельзя
+		if (v.Size > Capacity) { // иначе буфер используется повторно
+			int cap = v.Size;
+			T *p = NewBuffer(cap);
+			Drop();
+			pVector = p;
+			Capacity = cap;
+		}
+		Size = v.Size;
+	}
+	if (Alloc::Shared) Detach();
+
+	StartIndex = v.StartIndex;
+	for (int i = 0; i < Size; i++)
+	{
+		pVector[i] = v.pVector[i];
+	}
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // присваивание перемещением
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator=(TVector &&v)
+{
+	// в строку матрицы или из неё можно только скопировать, поэтому
+	// присваивание не noexcept: копирование может бросить исключение
+	if (this == &v) return *this;
+	if (!Owner || !v.Owner || v.IsLocal()) return *this = v;
+	Drop();
+	pVector = v.pVector;
+	Size = v.Size;
+	Capacity = v.Capacity;
+	StartIndex = v.StartIndex;
+	v.pVector = 0;
+	v.Size = 0;
+	v.Capacity = 0;
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // присваивание выражения одним проходом
+template <class E>
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator=(const TVecExpr<E> &e)
+{
+	// размер выражения совпадает с размером каждого операнда, поэтому
+	// если *this входит в выражение, память не перевыделяется
+	const E &ex = e.Self();
+	if (Size != ex.GetSize()) {
+		if (!Owner) throw - 1;
+		if (ex.GetSize() > Capacity) {
+			int cap = ex.GetSize();
+			T *p = NewBuffer(cap);
+			Drop();
+			pVector = p;
+			Capacity = cap;
+		}
+		Size = ex.GetSize();
+	}
+	if (Alloc::Shared) Detach();
+	StartIndex = ex.GetStartIndex();
+	ParallelEvalExpr(ex, pVector, Size);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // прибавить скаляр
+TVecScalar<TVector<T, Check, Alloc>, TOpAdd> TVector<T, Check, Alloc>::operator+(const T &val) const
+{
+	return TVecScalar<TVector, TOpAdd>(*this, val);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // вычесть скаляр
+TVecScalar<TVector<T, Check, Alloc>, TOpSub> TVector<T, Check, Alloc>::operator-(const T &val) const
+{
+	return TVecScalar<TVector, TOpSub>(*this, val);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // умножить на скаляр
+TVecScalar<TVector<T, Check, Alloc>, TOpMul> TVector<T, Check, Alloc>::operator*(const T &val) const
+{
+	return TVecScalar<TVector, TOpMul>(*this, val);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // скалярное произведение
+T TVector<T, Check, Alloc>::operator*(const TVector<T, Check, Alloc> &v) const
+{
+	if (Size != v.Size) throw - 1;
+	const T *a = pVector, *b = v.pVector;
+	return ParallelSum<T>(Size, int(VECTOR_ALIGNMENT / sizeof(T)),
+	  [a, b](int from, int to) { return SimdDot(a + from, b + from, to - from); });
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // прибавить скаляр на месте
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator+=(const T &val)
+{
+	if (Alloc::Shared) Detach();
+	ParallelEvalExpr(*this + val, pVector, Size);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // вычесть скаляр на месте
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator-=(const T &val)
+{
+	if (Alloc::Shared) Detach();
+	ParallelEvalExpr(*this - val, pVector, Size);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // умножить на скаляр на месте
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator*=(const T &val)
+{
+	if (Alloc::Shared) Detach();
+	ParallelEvalExpr(*this * val, pVector, Size);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // прибавить вектор на месте
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator+=(const TVector<T, Check, Alloc> &v)
+{
+	if (Size != v.Size) throw - 1;
+	if (Alloc::Shared) Detach();
+	ParallelEvalExpr(*this + v, pVector, Size);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // вычесть вектор на месте
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator-=(const TVector<T, Check, Alloc> &v)
+{
+	if (Size != v.Size) throw - 1;
+	if (Alloc::Shared) Detach();
+	ParallelEvalExpr(*this - v, pVector, Size);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // прибавить выражение на месте
+template <class E>
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator+=(const TVecExpr<E> &e)
+{
+	// размеры совпадают, поэтому присваивание считает на месте одним проходом
+	return *this = *this + e;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Check, class Alloc> // вычесть выражение на месте
+template <class E>
+TVector<T, Check, Alloc>& TVector<T, Check, Alloc>::operator-=(const TVecExpr<E> &e)
+{
+	return *this = *this - e;
+} /*-------------------------------------------------------------------------*/
+
+
+template <class L, class R> // скалярное произведение плотных векторов и представлений
+typename enable_if<TDense<L>::Value && TDense<R>::Value &&
+  is_same<typename L::ValueType, typename R::ValueType>::value, typename L::ValueType>::type
+operator*(const TVecExpr<L> &l, const TVecExpr<R> &r)
+{
+	typedef typename L::ValueType T;
+	int n = l.Self().GetSize();
+	if (n != r.Self().GetSize()) throw - 1;
+	const T *a = TDense<L>::Data(l.Self()), *b = TDense<R>::Data(r.Self());
+	return ParallelSum<T>(n, int(VECTOR_ALIGNMENT / sizeof(T)),
+	  [a, b](int from, int to) { return SimdDot(a + from, b + from, to - from); });
+} /*-------------------------------------------------------------------------*/
+
+// Реализация через агрегацию, где матрица - массив векторов
+template<class T>
+class ATMatrix {
+	int size;
+	TVector<T>* pMatrix;
+public:
+	ATMatrix(int s = 10);
+	TVector<T>& operator[](int ind);
+};
+
+template<class T>
+ATMatrix<T>::ATMatrix(int s)
+{
+	size = s;
+	pMatrix = new TVector<T>[size]; // size строк, и по-умолчанию столбцов
+	for (int i = 0; i < s; i++)
+	{
+		pMatrix[i] = TVector<T>(s - i, i);
+	}
+}
+
+template<class T>
+TVector<T>& ATMatrix<T>::operator[](int ind)
+{
+	if (ind <= 0 || ind >= size)
+		throw out_of_range("Index out of range");
+
+	return pMatrix[ind];
+}
+
+// Выражения над верхнетреугольными матрицами
+// Матрицы одного размера имеют одинаковую упаковку, поэтому сумма и
+// разность вычисляются по упакованному смещению k, одним проходом по
+// треугольнику прямо в матрицу-приёмник.
+template <class E>
+class TMatExpr
+{
+public:
+  const E& Self() const { return static_cast<const E&>(*this); }
+};
+
+// поэлементная операция над двумя матрицами
+template <class L, class R, class Op>
+class TMatBinary : public TMatExpr<TMatBinary<L, R, Op> >
+{
+  typename TExprStore<L>::type Left;
+  typename TExprStore<R>::type Right;
+public:
+  typedef typename L::ValueType ValueType;
+
+  TMatBinary(const L &l, const R &r): Left(l), Right(r)
+  {
+    if (Left.GetSize() != Right.GetSize()) throw - 1;
+  }
+  const L& GetLeft() const  { return Left;           }
+  const R& GetRight() const { return Right;          }
+  int GetSize() const       { return Left.GetSize(); }
+  auto Elem(int k) const -> decltype(Op::Apply(Left.Elem(k), Right.Elem(k)))
+  {
+    return Op::Apply(Left.Elem(k), Right.Elem(k));
+  }
+};
+
+template <class L, class R, class Op>
+struct TExprStore<TMatBinary<L, R, Op> > { typedef TMatBinary<L, R, Op> type; };
+
+template <class T, class A1, class A2, class Op>
+void EvalExpr(const TMatBinary<TMatrix<T, A1>, TMatrix<T, A2>, Op> &ex, T *dst, int from, int to)
+{
+	if (from < to)
+		SimdBinary<Op::Simd>(&ex.GetLeft().Elem(from), &ex.GetRight().Elem(from), dst + from, to - from);
+} /*-------------------------------------------------------------------------*/
+
+template <class L, class R> // сложение
+TMatBinary<L, R, TOpAdd> operator+(const TMatExpr<L> &l, const TMatExpr<R> &r)
+{
+	return TMatBinary<L, R, TOpAdd>(l.Self(), r.Self());
+} /*-------------------------------------------------------------------------*/
+
+template <class L, class R> // вычитание
+TMatBinary<L, R, TOpSub> operator-(const TMatExpr<L> &l, const TMatExpr<R> &r)
+{
+	return TMatBinary<L, R, TOpSub>(l.Self(), r.Self());
+} /*-------------------------------------------------------------------------*/
+
+template <class L, class R> // сравнение
+bool operator==(const TMatExpr<L> &l, const TMatExpr<R> &r)
+{
+	const L &a = l.Self();
+	const R &b = r.Self();
+	int n = a.GetSize();
+	if (n != b.GetSize()) return false;
+	int len = n * (n + 1) / 2;
+	for (int k = 0; k < len; k++)
+	{
+		if (a.Elem(k) != b.Elem(k)) return false;
+	}
+	return true;
+} /*-------------------------------------------------------------------------*/
+
+template <class L, class R> // сравнение
+bool operator!=(const TMatExpr<L> &l, const TMatExpr<R> &r)
+{
+	return !(l == r);
+} /*-------------------------------------------------------------------------*/
+
+// Прямоугольный блок матрицы: строки [i0, i1), столбцы [j0, j1)
+// упакованного верхнего треугольника размера n. Блок не владеет памятью,
+// индексы элементов и строк - индексы матрицы. Блок может задевать нижний
+// треугольник: его элементы (i, j), j < i, не хранятся и равны нулю, доступ
+// к ним - out_of_range, операции над блоком их пропускают. Хранимая часть
+// строки блока - непрерывный отрезок строки матрицы (Row). Как и у
+// TVectorView, копия блока ссылается на те же элементы, а присваивание
+// блоку записывает элементы. TMatBlock<const T> - блок только для чтения
+// (блок константной матрицы).
+template <class T>
+class TMatBlock
+{
+  T *pData;      // упакованный треугольник матрицы
+  int N;         // размер матрицы
+  int I0, I1;    // строки блока
+  int J0, J1;    // столбцы блока
+
+  T* RowPtr(int i) const { return pData + i * N - i * (i - 1) / 2 - i; } // RowPtr(i)[j] = A[i][j]
+  int RowBegin(int i) const { return min(max(J0, i), J1); } // первый хранимый столбец строки i
+  template <class U>
+  bool SameShape(const TMatBlock<U> &b) const; // размеры и хранимые элементы совпадают
+
+  template <class> friend class TMatBlock;
+public:
+  typedef typename remove_const<T>::type ValueType;
+
+  TMatBlock(T *data, int n, int i0, int i1, int j0, int j1);
+  TMatBlock(const TMatBlock &b) = default;
+  template <class U, class = typename enable_if<is_same<const U, T>::value>::type>
+  TMatBlock(const TMatBlock<U> &b): pData(b.pData), N(b.N), I0(b.I0), I1(b.I1), J0(b.J0), J1(b.J1) {}
+  int GetRowIndex() const { return I0;      } // первая строка
+  int GetColIndex() const { return J0;      } // первый столбец
+  int GetRows() const     { return I1 - I0; } // число строк
+  int GetCols() const     { return J1 - J0; } // число столбцов
+  T& operator()(int i, int j) const;          // хранимый элемент (i, j) матрицы, i <= j
+  TVectorView<T> Row(int i) const;            // хранимая часть строки i блока
+  // произведение блока на вектор x из GetCols() элементов (x[k] - столбец J0 + k)
+  TVector<ValueType> operator*(TVectorView<const ValueType> x) const;
+
+  // поэлементные операции над хранимыми элементами блоков одной формы
+  // (размеры и расположение относительно диагонали), иначе - исключение
+  TMatBlock& operator=(const TMatBlock &b);
+  template <class U>
+  TMatBlock& operator=(const TMatBlock<U> &b);
+  template <class U>
+  TMatBlock& operator+=(const TMatBlock<U> &b);
+  template <class U>
+  TMatBlock& operator-=(const TMatBlock<U> &b);
+  TMatBlock& operator*=(const ValueType &val);
+
+  // решение системы с диагональным блоком (i0 == j0, i1 == j1) обратной
+  // подстановкой; b - из GetRows() элементов
+  TVector<ValueType> Solve(TVectorView<const ValueType> b) const;
+  void SolveInPlace(TVectorView<ValueType> b) const; // x записывается в b
+};
+
+template <class T>
+TMatBlock<T>::TMatBlock(T *data, int n, int i0, int i1, int j0, int j1):
+  pData(data), N(n), I0(i0), I1(i1), J0(j0), J1(j1)
+{
+	if (i0 < 0 || i0 > i1 || i1 > n || j0 < 0 || j0 > j1 || j1 > n)
+		throw out_of_range("Index out of range");
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // совпадение формы
+template <class U>
+bool TMatBlock<T>::SameShape(const TMatBlock<U> &b) const
+{
+	if (I1 - I0 != b.I1 - b.I0 || J1 - J0 != b.J1 - b.J0) return false;
+	for (int r = 0; r < I1 - I0; r++)
+	{
+		if (RowBegin(I0 + r) - J0 != b.RowBegin(b.I0 + r) - b.J0) return false;
+	}
+	return true;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // доступ к элементу
+T& TMatBlock<T>::operator()(int i, int j) const
+{
+	if (j < i || (TDebugBoundsCheck::Enabled && (i < I0 || i >= I1 || j < J0 || j >= J1)))
+		throw out_of_range("Index out of range");
+	return RowPtr(i)[j];
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // строка блока
+TVectorView<T> TMatBlock<T>::Row(int i) const
+{
+	if (i < I0 || i >= I1)
+		throw out_of_range("Index out of range");
+	int j = RowBegin(i);
+	return TVectorView<T>(RowPtr(i) + j, J1 - j, j);
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // произведение на вектор
+TVector<typename TMatBlock<T>::ValueType> TMatBlock<T>::operator*(TVectorView<const ValueType> x) const
+{
+	// y[i] = сумма A[i][j] * x[j - J0] по хранимым столбцам строки i
+	if (x.GetSize() != J1 - J0) throw - 1;
+	TVector<ValueType> y(I1 - I0, I0, ZERO_INIT);
+	for (int i = I0; i < I1; i++)
+	{
+		int j = RowBegin(i);
+		if (j < J1)
+			y.pVector[i - I0] = SimdDot(RowPtr(i) + j, x.pData + j - J0, J1 - j);
+	}
+	return y;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // запись элементов блока
+TMatBlock<T>& TMatBlock<T>::operator=(const TMatBlock &b)
+{
+	return operator=<T>(b);
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // запись элементов блока
+template <class U>
+TMatBlock<T>& TMatBlock<T>::operator=(const TMatBlock<U> &b)
+{
+	static_assert(!is_const<T>::value, "read-only block cannot be assigned");
+	if (!SameShape(b)) throw - 1;
+	for (int i = I0; i < I1; i++)
+	{
+		int j = RowBegin(i);
+		copy(b.RowPtr(i - I0 + b.I0) + j - J0 + b.J0, b.RowPtr(i - I0 + b.I0) + J1 - J0 + b.J0, RowPtr(i) + j);
+	}
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // прибавить блок
+template <class U>
+TMatBlock<T>& TMatBlock<T>::operator+=(const TMatBlock<U> &b)
+{
+	static_assert(!is_const<T>::value, "read-only block cannot be changed");
+	if (!SameShape(b)) throw - 1;
+	for (int i = I0; i < I1; i++)
+	{
+		int j = RowBegin(i);
+		T *dst = RowPtr(i) + j;
+		SimdBinary<SIMD_ADD>(dst, b.RowPtr(i - I0 + b.I0) + j - J0 + b.J0, dst, J1 - j);
+	}
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // вычесть блок
+template <class U>
+TMatBlock<T>& TMatBlock<T>::operator-=(const TMatBlock<U> &b)
+{
+	static_assert(!is_const<T>::value, "read-only block cannot be changed");
+	if (!SameShape(b)) throw - 1;
+	for (int i = I0; i < I1; i++)
+	{
+		int j = RowBegin(i);
+		T *dst = RowPtr(i) + j;
+		SimdBinary<SIMD_SUB>(dst, b.RowPtr(i - I0 + b.I0) + j - J0 + b.J0, dst, J1 - j);
+	}
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // умножить на скаляр
+TMatBlock<T>& TMatBlock<T>::operator*=(const ValueType &val)
+{
+	static_assert(!is_const<T>::value, "read-only block cannot be changed");
+	for (int i = I0; i < I1; i++)
+	{
+		int j = RowBegin(i);
+		T *dst = RowPtr(i) + j;
+		SimdScalar<SIMD_MUL>(dst, val, dst, J1 - j);
+	}
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // решение системы с диагональным блоком
+TVector<typename TMatBlock<T>::ValueType> TMatBlock<T>::Solve(TVectorView<const ValueType> b) const
+{
+	TVector<ValueType> x(b);
+	SolveInPlace(x);
+	return x;
+} /*-------------------------------------------------------------------------*/
+
+template <class T> // решение системы с диагональным блоком на месте
+void TMatBlock<T>::SolveInPlace(TVectorView<ValueType> b) const
+{
+	if (I0 != J0 || I1 != J1 || b.GetSize() != I1 - I0) throw - 1;
+	ValueType *x = b.pData - I0; // x[i] - неизвестное строки i
+	for (int i = I1 - 1; i >= I0; i--)
+	{
+		const T *u = RowPtr(i); // u[j] = U[i][j]
+		if (u[i] == ValueType()) throw - 1; // вырожденный блок
+		x[i] = (x[i] - SimdDot(u + i + 1, x + i + 1, I1 - i - 1)) / u[i];
+	}
+} /*-------------------------------------------------------------------------*/
+
+// Верхнетреугольная матрица
+// Реализация через наследование
+// задание. Написать оператор умножения матриц.
+//
+// Элементы хранятся в одном буфере pData, упакованном по строкам:
+// строка i занимает n - i элементов начиная со смещения RowOffset(n, i).
+// Строки, доступные через operator[], - представления этого буфера.
+// Сложение и вычитание строят выражения TMatBinary (см. выше).
+// Блок памяти матрицы (строки и элементы) выделяет распределитель Alloc
+// (см. utalloc.h).
+template <class T, class Alloc>
+class TMatrix : public TVector<TVector<T> >, public TMatExpr<TMatrix<T, Alloc> >
 {
 protected:
-  T *pVector;
-  int Size;       // размер вектора
-  int StartIndex; // индекс первого элемента вектора
+  T *pData; // упакованный верхний треугольник, n(n+1)/2 элементов
+
+  static int PackedSize(int n)       { return n * (n + 1) / 2;       }
+  static int RowOffset(int n, int i) { return i * n - i * (i - 1) / 2; }
+  static size_t DataOffset(int s)    { return AlignedSize(s * sizeof(TVector<T>)); }
+  static size_t BlockSize(int s)     { return DataOffset(s) + PackedSize(s) * sizeof(T); }
+  void Allocate(int s);                          // выделение памяти под s строк одним блоком
+  void Release();                                // освобождение памяти
+  void SetRows(int s);                           // строки матрицы размера s в текущем блоке
+  void Resize(int s);                            // смена размера, блок по возможности сохраняется
+  template <class E>
+  void EvalPacked(const E &ex);                  // вычисление выражения в pData, по потокам
+  void SolveBlocked(T **xs, int m, int order) const; // решение для m правых частей
+  void SolveGraph(T **xs, int m) const;          // то же в пуле потоков по графу блоков
+  // упакованные для микроядра умножения полосы множителей (см. MulTile)
+  static int StripOffset(int n, int s) { return SIMD_TILE_ROWS * (s * n - SIMD_TILE_ROWS * s * (s - 1) / 2); }
+  static int PanelOffset(int nr, int p) { return nr * nr * p * (p + 1) / 2; }
+  void PackStrip(T *ap, int s) const;            // строки s-й полосы A
+  void PackPanel(T *bp, int nr, int p) const;    // столбцы p-й полосы B
+  void MulTile(const T *ap, const T *bp, int nr, T *c, int ib, int jb) const; // блок (ib, jb) произведения в c
 public:
-  TVector(int s = 10, int si = 0);
-  TVector(const TVector &v);                // конструктор копирования
-  ~TVector();
-  int GetSize()      { return Size;       } // размер вектора
-  int GetStartIndex(){ return StartIndex; } // индекс первого элемента
-  T& operator[](int pos);             // доступ
-  bool operator==(const TVector &v) const;  // сравнение
-  bool operator!=(const TVector &v) const;  // сравнение
-  TVector& operator=(const TVector &v);     // присваивание
+  typedef T ValueType;
+
+  TMatrix(int s = 10);
+  TMatrix(const TMatrix &mt);                    // копирование
+  TMatrix(TMatrix &&mt) noexcept;                // перемещение
+  TMatrix(const TVector<TVector<T> > &mt); // преобразование типа
+  TMatrix(TVector<TVector<T> > &&mt);      // преобразование с перемещением элементов
+  template <class E, class = typename enable_if<is_same<typename E::ValueType, T>::value>::type>
+  TMatrix(const TMatExpr<E> &e);                 // вычисление выражения
+  ~TMatrix();
+  // ёмкость (GetCapacity) - наибольший размер матрицы, при котором блок
+  // памяти не перевыделяется
+  void reserve(int cap);                         // ёмкость не меньше cap
+  void shrink_to_fit();                          // ёмкость равна размеру
+  const T& Elem(int k) const { return pData[k]; } // элемент по упакованному смещению k
+  T& operator()(int i, int j);                   // элемент (i, j), i <= j, без обращения к строке
+  const T& operator()(int i, int j) const;
+  // представления без копирования (см. TVectorView, TMatBlock)
+  TVectorView<T> Row(int i, int j0, int j1);     // столбцы [j0, j1) строки i
+  TVectorView<const T> Row(int i, int j0, int j1) const;
+  TMatBlock<T> Block(int i0, int i1, int j0, int j1); // строки [i0, i1), столбцы [j0, j1)
+  TMatBlock<const T> Block(int i0, int i1, int j0, int j1) const;
+  bool operator==(const TMatrix &mt) const;      // сравнение
+  bool operator!=(const TMatrix &mt) const;      // сравнение
+  template <class E>
+  bool operator==(const TMatExpr<E> &e) const;   // сравнение с выражением
+  template <class E>
+  bool operator!=(const TMatExpr<E> &e) const;   // сравнение с выражением
+  TMatrix& operator= (const TMatrix &mt);        // присваивание
+  TMatrix& operator= (TMatrix &&mt) noexcept;    // присваивание перемещением
+  template <class E>
+  TMatrix& operator= (const TMatExpr<E> &e);     // присваивание выражения
+  template <class E>
+  TMatBinary<TMatrix, E, TOpAdd> operator+ (const TMatExpr<E> &e) const; // сложение
+  template <class E>
+  TMatBinary<TMatrix, E, TOpSub> operator- (const TMatExpr<E> &e) const; // вычитание
+  TMatrix  operator* (const TMatrix &mt) const;  // умножение
 
-  // скалярные операции
-  TVector  operator+(const T &val);   // прибавить скаляр
-  TVector  operator-(const T &val);   // вычесть скаляр
-  TVector  operator*(const T &val);   // умножить на скаляр
+  // операции на месте (память матрицы не перевыделяется)
+  TMatrix& operator+=(const TMatrix &mt);        // прибавить матрицу
+  TMatrix& operator-=(const TMatrix &mt);        // вычесть матрицу
+  template <class E>
+  TMatrix& operator+=(const TMatExpr<E> &e);     // прибавить выражение
+  template <class E>
+  TMatrix& operator-=(const TMatExpr<E> &e);     // вычесть выражение
+  TMatrix& operator*=(const T &val);             // умножить на скаляр
 
-  // векторные операции
-  TVector  operator+(const TVector &v);     // сложение
-  TVector  operator-(const TVector &v);     // вычитание
-  T  operator*(const TVector &v);     // скалярное произведение
+  // решение системы Ux = b обратной подстановкой
+  TVector<T> Solve(const TVector<T> &b, int order = SOLVE_ROWS) const;
+  void SolveInPlace(TVector<T> &b, int order = SOLVE_ROWS) const; // x записывается в b
+  void SolveInPlace(TVectorView<T> b, int order = SOLVE_ROWS) const; // x записывается в представление b
+  // решение для нескольких правых частей UX = B (столбцы X и B - векторы)
+  TVector<TVector<T> > Solve(const TVector<TVector<T> > &B, int order = SOLVE_ROWS) const;
+  void SolveInPlace(TVector<TVector<T> > &B, int order = SOLVE_ROWS) const;
 
-  // ввод-вывод
-  friend istream& operator>>(istream &in, TVector &v)
+  // ввод / вывод
+  friend istream& operator>>(istream &in, TMatrix &mt)
   {
-    for (int i = 0; i < v.Size; i++)
-      in >> v.pVector[i];
+    for (int i = 0; i < mt.Size; i++)
+      in >> mt.pVector[i];
     return in;
   }
-  friend ostream& operator<<(ostream &out, const TVector &v)
+  friend ostream & operator<<( ostream &out, const TMatrix &mt)
   {
-    for (int i = 0; i < v.Size; i++)
-      out << v.pVector[i] << ' ';
+    for (int i = 0; i < mt.Size; i++)
+      out << mt.pVector[i] << endl;
     return out;
   }
 };
 
-template <class T>
-TVector<T>::TVector(int s, int si)
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::Allocate(int s)
 {
-	//Новый код
-	if (s<0 || s > MAX_VECTOR_SIZE || si < 0)
-		throw -1;
-	Size = s;
-	StartIndex = si;
-	pVector = new T[Size];
-
+	// Один блок памяти: сначала заголовки строк, затем элементы. Каждая
+	// строка создаётся один раз, сразу нужного размера. Элементы начинаются
+	// с границы VECTOR_ALIGNMENT, как буфер вектора. Блок вмещает матрицу
+	// любого размера до s (ёмкость): упаковка зависит только от размера.
+	int len = PackedSize(s);
+	char *block = static_cast<char*>(Alloc::Allocate(BlockSize(s)));
+	T *data = reinterpret_cast<T*>(block + DataOffset(s));
+	try {
+		DefaultConstruct(data, len);
+	}
+	catch (...) {
+		Alloc::Free(block, BlockSize(s));
+		throw;
+	}
+	pData = data;
+	this->pVector = reinterpret_cast<TVector<T>*>(block);
+	this->Size = 0;
+	this->Capacity = s;
+	SetRows(s);
 } /*-------------------------------------------------------------------------*/
 
-template <class T> //конструктор копирования
-TVector<T>::TVector(const TVector<T> &v)
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::Release()
 {
-	Size = v.Size;
-	StartIndex = v.StartIndex;
-	pVector = new T[Size];
-	for (int i = 0; i < Size; i++)
+	int len = PackedSize(this->Capacity);
+	for (int k = 0; k < len; k++)
 	{
-		pVector[i] = v.pVector[i];
+		pData[k].~T();
+	}
+	for (int i = 0; i < this->Size; i++)
+	{
+		this->pVector[i].~TVector<T>();
 	}
+	if (this->pVector)
+		Alloc::Free(this->pVector, BlockSize(this->Capacity));
+	this->pVector = 0;
+	this->Size = 0;
+	this->Capacity = 0;
+	pData = 0;
 } /*-------------------------------------------------------------------------*/
 
-template <class T>
-TVector<T>::~TVector()
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::SetRows(int s)
 {
-	delete[]pVector;
+	for (int i = 0; i < this->Size; i++)
+	{
+		this->pVector[i].~TVector<T>();
+	}
+	this->Size = s;
+	for (int i = 0; i < s; i++)
+	{
+		new (this->pVector + i) TVector<T>(pData + RowOffset(s, i), s - i, i);
+	}
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // доступ
-T& TVector<T>::operator[](int ind)
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::Resize(int s)
 {
-	// в неконстантных методах могут вызываться константные методы
-	if (ind - this->GetStartIndex() < 0 || ind - this->GetStartIndex() >= Size)
-		throw out_of_range("Index out of range");
-	return pVector[ind - StartIndex]; // учесть startIndex
+	if (s == this->Size) return;
+	if (s <= this->Capacity) {
+		SetRows(s);
+		return;
+	}
+	Release();
+	Allocate(s);
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // сравнение
-bool TVector<T>::operator==(const TVector &v) const
+// Упакованный треугольник хранится строками подряд, поэтому деление
+// [0, n(n+1)/2) на равные по числу элементов части даёт потокам равную
+// работу (при делении по строкам первые строки длиннее последних).
+// Ниже GetParallelThreshold() элементов выражение вычисляется в
+// вызывающем потоке.
+template <class T, class Alloc>
+template <class E>
+void TMatrix<T, Alloc>::EvalPacked(const E &ex)
 {
-	if (Size != v.Size || StartIndex != v.StartIndex) return false;
+	ParallelEvalExpr(ex, pData, PackedSize(this->Size));
+} /*-------------------------------------------------------------------------*/
 
-	for (int i = 0; i < Size; i++)
+template <class T, class Alloc> // резервирование памяти
+void TMatrix<T, Alloc>::reserve(int cap)
+{
+	if (cap < 0 || cap >= MAX_MATRIX_SIZE) throw - 1;
+	if (cap <= this->Capacity) return;
+	TMatrix tmp(cap);
+	tmp.SetRows(this->Size);
+	int len = PackedSize(this->Size);
+	for (int k = 0; k < len; k++)
 	{
-		if (pVector[i] != v.pVector[i]) return false;
+		tmp.pData[k] = std::move(pData[k]);
 	}
-	return true;
+	*this = std::move(tmp);
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // сравнение
-bool TVector<T>::operator!=(const TVector &v) const
+template <class T, class Alloc> // освобождение лишней памяти
+void TMatrix<T, Alloc>::shrink_to_fit()
 {
-	return !(*this == v);
+	if (this->Capacity == this->Size) return;
+	TMatrix tmp(this->Size);
+	int len = PackedSize(this->Size);
+	for (int k = 0; k < len; k++)
+	{
+		tmp.pData[k] = std::move(pData[k]);
+	}
+	*this = std::move(tmp);
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // присваивание
-TVector<T>& TVector<T>::operator=(const TVector &v)
+template <class T, class Alloc>
+TMatrix<T, Alloc>::TMatrix(int s): TVector<TVector<T> >((TVector<T>*)0, 0, 0), pData(0)
 {
-	if (this == &v) return *this;
-	if (Size != v.Size) {
-		delete[]pVector;
-		pVector = new T[v.Size];
-		Size = v.Size;
-
-	}
+	if (s >= MAX_MATRIX_SIZE || s < 0) throw - 1;
+	Allocate(s);
+} /*-------------------------------------------------------------------------*/
 
-	StartIndex = v.StartIndex;
-	for (int i = 0; i < Size; i++)
+template <class T, class Alloc> // конструктор копирования
+TMatrix<T, Alloc>::TMatrix(const TMatrix<T, Alloc> &mt):
+  TVector<TVector<T> >((TVector<T>*)0, 0, 0), pData(0)
+{
+	Allocate(mt.Size);
+	int len = PackedSize(this->Size);
+	for (int k = 0; k < len; k++)
 	{
-		pVector[i] = v.pVector[i];
+		pData[k] = mt.pData[k];
 	}
-	return *this;
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // прибавить скаляр
-TVector<T> TVector<T>::operator+(const T &val)
+template <class T, class Alloc> // конструктор перемещения
+TMatrix<T, Alloc>::TMatrix(TMatrix<T, Alloc> &&mt) noexcept:
+  TVector<TVector<T> >(mt.pVector, mt.Size, 0), pData(mt.pData)
 {
-	TVector tmp = TVector(Size);
-	for (int i = 0; i < Size; i++)
-	{
-		tmp.pVector[i] = pVector[i] + val;
-	}
-	return tmp;
+	this->Capacity = mt.Capacity;
+	mt.pVector = 0;
+	mt.Size = 0;
+	mt.Capacity = 0;
+	mt.pData = 0;
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // вычесть скаляр
-TVector<T> TVector<T>::operator-(const T &val)
+template <class T, class Alloc> // конструктор преобразования типа
+TMatrix<T, Alloc>::TMatrix(const TVector<TVector<T> > &mt):
+  TVector<TVector<T> >((TVector<T>*)0, 0, 0), pData(0)
 {
-	TVector tmp = TVector(Size);
-	for (int i = 0; i < Size; i++)
+	int s = mt.Size;
+	if (s >= MAX_MATRIX_SIZE) throw - 1;
+	for (int i = 0; i < s; i++)
 	{
-		tmp.pVector[i] = pVector[i] - val;
+		if (mt.pVector[i].Size != s - i) throw - 1; // не треугольная форма
+	}
+	Allocate(s);
+	for (int i = 0; i < s; i++)
+	{
+		T *row = pData + RowOffset(s, i);
+		for (int j = 0; j < s - i; j++)
+		{
+			row[j] = mt.pVector[i].pVector[j];
+		}
 	}
-	return tmp;
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // умножить на скаляр
-TVector<T> TVector<T>::operator*(const T &val)
-{
-	TVector tmp = TVector(Size);
-	for (int i = 0; i < Size; i++)
+template <class T, class Alloc> // конструктор преобразования типа с перемещением
+TMatrix<T, Alloc>::TMatrix(TVector<TVector<T> > &&mt):
+  TVector<TVector<T> >((TVector<T>*)0, 0, 0), pData(0)
+{ // строки mt не упакованы, поэтому забрать можно только сами элементы
+	int s = mt.Size;
+	if (s >= MAX_MATRIX_SIZE) throw - 1;
+	for (int i = 0; i < s; i++)
 	{
-		tmp.pVector[i] = pVector[i] * val;
+		if (mt.pVector[i].Size != s - i) throw - 1; // не треугольная форма
+	}
+	Allocate(s);
+	for (int i = 0; i < s; i++)
+	{
+		T *row = pData + RowOffset(s, i);
+		for (int j = 0; j < s - i; j++)
+		{
+			row[j] = std::move(mt.pVector[i].pVector[j]);
+		}
 	}
-	return tmp;
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // сложение
-TVector<T> TVector<T>::operator+(const TVector<T> &v)
+template <class T, class Alloc> // вычисление выражения одним проходом
+template <class E, class>
+TMatrix<T, Alloc>::TMatrix(const TMatExpr<E> &e):
+  TVector<TVector<T> >((TVector<T>*)0, 0, 0), pData(0)
 {
-	if (Size != v.Size) throw - 1;
-	TVector tmp = TVector(Size);
-	tmp.StartIndex = StartIndex;
-	for (int i = 0; i < Size; i++)
-	{
-		tmp.pVector[i] = pVector[i] + v.pVector[i];
-		
-	}
-	return tmp;
+	const E &ex = e.Self();
+	Allocate(ex.GetSize());
+	EvalPacked(ex);
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // вычитание
-TVector<T> TVector<T>::operator-(const TVector<T> &v)
+template <class T, class Alloc>
+TMatrix<T, Alloc>::~TMatrix()
 {
-	if (Size != v.Size) throw - 1;
-	TVector tmp = TVector(Size);
-	tmp.StartIndex = StartIndex;
-	for (int i = 0; i < Size; i++)
-	{
-		tmp.pVector[i] = pVector[i] - v.pVector[i];
-	}
-	return tmp;
+	Release();
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // скалярное произведение
-T TVector<T>::operator*(const TVector<T> &v)
+template <class T, class Alloc> // доступ к элементу
+T& TMatrix<T, Alloc>::operator()(int i, int j)
 {
-	if (Size != v.Size) throw - 1;
-	T tmp = 0;
-	for (int i = 0; i < Size; i++)
+	// адрес считается сразу по упакованному смещению; индексы проверяются
+	// только в отладочной сборке (без NDEBUG)
+	if (TDebugBoundsCheck::Enabled && (i < 0 || i > j || j >= this->Size))
+		throw out_of_range("Index out of range");
+	return pData[RowOffset(this->Size, i) + j - i];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // доступ к элементу
+const T& TMatrix<T, Alloc>::operator()(int i, int j) const
+{
+	if (TDebugBoundsCheck::Enabled && (i < 0 || i > j || j >= this->Size))
+		throw out_of_range("Index out of range");
+	return pData[RowOffset(this->Size, i) + j - i];
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // отрезок строки
+TVectorView<T> TMatrix<T, Alloc>::Row(int i, int j0, int j1)
+{
+	int n = this->Size;
+	if (i < 0 || i >= n || j0 < i || j0 > j1 || j1 > n)
+		throw out_of_range("Index out of range");
+	return TVectorView<T>(pData + RowOffset(n, i) + j0 - i, j1 - j0, j0);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // отрезок строки
+TVectorView<const T> TMatrix<T, Alloc>::Row(int i, int j0, int j1) const
+{
+	int n = this->Size;
+	if (i < 0 || i >= n || j0 < i || j0 > j1 || j1 > n)
+		throw out_of_range("Index out of range");
+	return TVectorView<const T>(pData + RowOffset(n, i) + j0 - i, j1 - j0, j0);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // блок
+TMatBlock<T> TMatrix<T, Alloc>::Block(int i0, int i1, int j0, int j1)
+{
+	return TMatBlock<T>(pData, this->Size, i0, i1, j0, j1);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // блок
+TMatBlock<const T> TMatrix<T, Alloc>::Block(int i0, int i1, int j0, int j1) const
+{
+	return TMatBlock<const T>(pData, this->Size, i0, i1, j0, j1);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // сравнение
+bool TMatrix<T, Alloc>::operator==(const TMatrix<T, Alloc> &mt) const
+{ // при создании матрицы startIndex будет 0 (он является потомком класса вектора)
+	if (this->Size != mt.Size) return false;
+	int len = PackedSize(this->Size);
+	for (int k = 0; k < len; k++)
 	{
-		tmp += pVector[i] * v.pVector[i];
+		if (pData[k] != mt.pData[k]) return false;
 	}
-	return tmp;
+	return true;
 } /*-------------------------------------------------------------------------*/
 
+template <class T, class Alloc> // сравнение
+bool TMatrix<T, Alloc>::operator!=(const TMatrix<T, Alloc> &mt) const
+{
+	return !(*this == mt);
+} /*-------------------------------------------------------------------------*/
 
+template <class T, class Alloc> // сравнение с выражением
+template <class E>
+bool TMatrix<T, Alloc>::operator==(const TMatExpr<E> &e) const
+{
+	return static_cast<const TMatExpr<TMatrix>&>(*this) == e;
+} /*-------------------------------------------------------------------------*/
 
-// Реализация через агрегацию, где матрица - массив векторов
-template<class T>
-class ATMatrix {
-	int size;
-	TVector<T>* pMatrix;
-public:
-	ATMatrix(int s = 10);
-	TVector<T>& operator[](int ind);
-};
+template <class T, class Alloc> // сравнение с выражением
+template <class E>
+bool TMatrix<T, Alloc>::operator!=(const TMatExpr<E> &e) const
+{
+	return !(*this == e);
+} /*-------------------------------------------------------------------------*/
 
-template<class T>
-ATMatrix<T>::ATMatrix(int s)
+template <class T, class Alloc> // присваивание
+TMatrix<T, Alloc>& TMatrix<T, Alloc>::operator=(const TMatrix<T, Alloc> &mt)
 {
-	size = s;
-	pMatrix = new TVector<T>[size]; // size строк, и по-умолчанию столбцов
-	for (int i = 0; i < s; i++)
+	if (this == &mt) return *this;
+	Resize(mt.Size); // при достаточной ёмкости блок используется повторно
+	int len = PackedSize(this->Size);
+	for (int k = 0; k < len; k++)
 	{
-		pMatrix[i] = TVector<T>(s - i, i);
+		pData[k] = mt.pData[k];
 	}
-}
+	return *this;
+} /*-------------------------------------------------------------------------*/
 
-template<class T>
-TVector<T>& ATMatrix<T>::operator[](int ind)
+template <class T, class Alloc> // присваивание перемещением
+TMatrix<T, Alloc>& TMatrix<T, Alloc>::operator=(TMatrix<T, Alloc> &&mt) noexcept
 {
-	if (ind <= 0 || ind >= size)
-		throw out_of_range("Index out of range");
+	if (this == &mt) return *this;
+	Release();
+	this->pVector = mt.pVector;
+	this->Size = mt.Size;
+	this->Capacity = mt.Capacity;
+	pData = mt.pData;
+	mt.pVector = 0;
+	mt.Size = 0;
+	mt.Capacity = 0;
+	mt.pData = 0;
+	return *this;
+} /*-------------------------------------------------------------------------*/
 
-	return pMatrix[ind];
-}
+template <class T, class Alloc> // присваивание выражения одним проходом
+template <class E>
+TMatrix<T, Alloc>& TMatrix<T, Alloc>::operator=(const TMatExpr<E> &e)
+{
+	const E &ex = e.Self();
+	Resize(ex.GetSize());
+	EvalPacked(ex);
+	return *this;
+} /*-------------------------------------------------------------------------*/
 
+template <class T, class Alloc> // сложение
+template <class E>
+TMatBinary<TMatrix<T, Alloc>, E, TOpAdd> TMatrix<T, Alloc>::operator+(const TMatExpr<E> &e) const
+{
+	return TMatBinary<TMatrix, E, TOpAdd>(*this, e.Self());
+} /*-------------------------------------------------------------------------*/
 
-// Верхнетреугольная матрица
-// Реализация через наследование
-// задание. Написать оператор умножения матриц.
-template <class T>
-class TMatrix : public TVector<TVector<T> >
+template <class T, class Alloc> // вычитание
+template <class E>
+TMatBinary<TMatrix<T, Alloc>, E, TOpSub> TMatrix<T, Alloc>::operator-(const TMatExpr<E> &e) const
 {
-public:
-  TMatrix(int s = 10);                           
-  TMatrix(const TMatrix &mt);                    // копирование
-  TMatrix(const TVector<TVector<T> > &mt); // преобразование типа
-  bool operator==(const TMatrix &mt) const;      // сравнение
-  bool operator!=(const TMatrix &mt) const;      // сравнение
-  TMatrix& operator= (const TMatrix &mt);        // присваивание
-  TMatrix  operator+ (const TMatrix &mt);        // сложение
-  TMatrix  operator- (const TMatrix &mt);        // вычитание
+	return TMatBinary<TMatrix, E, TOpSub>(*this, e.Self());
+} /*-------------------------------------------------------------------------*/
 
-  // ввод / вывод
-  friend istream& operator>>(istream &in, TMatrix &mt)
-  {
-    for (int i = 0; i < mt.Size; i++)
-      in >> mt.pVector[i];
-    return in;
-  }
-  friend ostream & operator<<( ostream &out, const TMatrix &mt)
-  {
-    for (int i = 0; i < mt.Size; i++)
-      out << mt.pVector[i] << endl;
-    return out;
-  }
-};
+template <class T, class Alloc> // прибавить матрицу на месте
+TMatrix<T, Alloc>& TMatrix<T, Alloc>::operator+=(const TMatrix<T, Alloc> &mt)
+{
+	if (this->Size != mt.Size) throw - 1;
+	EvalPacked(*this + mt);
+	return *this;
+} /*-------------------------------------------------------------------------*/
 
-template <class T>
-TMatrix<T>::TMatrix(int s): TVector<TVector<T> >(s)
+template <class T, class Alloc> // вычесть матрицу на месте
+TMatrix<T, Alloc>& TMatrix<T, Alloc>::operator-=(const TMatrix<T, Alloc> &mt)
 {
-	if (s >= MAX_MATRIX_SIZE || s < 0) throw - 1;
-	for (int i = 0; i < s; i++)
+	if (this->Size != mt.Size) throw - 1;
+	EvalPacked(*this - mt);
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // прибавить выражение на месте
+template <class E>
+TMatrix<T, Alloc>& TMatrix<T, Alloc>::operator+=(const TMatExpr<E> &e)
+{
+	return *this = *this + e;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // вычесть выражение на месте
+template <class E>
+TMatrix<T, Alloc>& TMatrix<T, Alloc>::operator-=(const TMatExpr<E> &e)
+{
+	return *this = *this - e;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // умножить на скаляр на месте
+TMatrix<T, Alloc>& TMatrix<T, Alloc>::operator*=(const T &val)
+{
+	T *p = pData;
+	ParallelRange(PackedSize(this->Size), int(VECTOR_ALIGNMENT / sizeof(T)),
+	  [p, &val](int from, int to) { SimdScalar<SIMD_MUL>(p + from, val, p + from, to - from); });
+	return *this;
+} /*-------------------------------------------------------------------------*/
+
+// Множители упаковываются один раз в порядке чтения микроядром SimdTile
+// (utsimd.h). Полоса s матрицы A - строки r0 = s * SIMD_TILE_ROWS ..
+// r0 + SIMD_TILE_ROWS - 1 по столбцам k = r0..n-1, в каждом столбце
+// SIMD_TILE_ROWS элементов подряд: ap[(k - r0) * SIMD_TILE_ROWS + r] = A[r0 + r][k].
+// Полоса p матрицы B - столбцы c0 = p * nr .. c0 + nr - 1 по строкам
+// k = 0..c0 + nr - 1: bp[k * nr + q] = B[k][c0 + q]. Элементы нижних
+// половин и за границей матрицы - нули.
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::PackStrip(T *ap, int s) const
+{
+	const int MR = SIMD_TILE_ROWS;
+	int n = this->Size, r0 = s * MR;
+	T *dst = ap + StripOffset(n, s) - r0 * MR; // dst[k * MR + r]
+	for (int r = 0; r < MR; r++)
 	{
-		pVector[i] = TVector<T>(s - i, i);
+		int i = r0 + r, k = r0;
+		for (; k < min(i, n); k++)
+		{
+			dst[k * MR + r] = T();
+		}
+		const T *a = i < n ? pData + RowOffset(n, i) - i : 0; // a[k] = A[i][k]
+		for (; k < n; k++)
+		{
+			dst[k * MR + r] = a[k];
+		}
 	}
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // конструктор копирования
-TMatrix<T>::TMatrix(const TMatrix<T> &mt):
-  TVector<TVector<T> >(mt) {}
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::PackPanel(T *bp, int nr, int p) const
+{
+	int n = this->Size, c0 = p * nr, c1 = min(c0 + nr, n);
+	T *dst = bp + PanelOffset(nr, p) - c0; // dst[k * nr + j] = B[k][j]
+	for (int k = 0; k < c1; k++, dst += nr)
+	{
+		const T *b = pData + RowOffset(n, k) - k; // b[j] = B[k][j]
+		for (int j = c0; j < c0 + nr; j++)
+		{
+			dst[j] = j >= k && j < c1 ? b[j] : T();
+		}
+	}
+} /*-------------------------------------------------------------------------*/
 
-template <class T> // конструктор преобразования типа
-TMatrix<T>::TMatrix(const TVector<TVector<T> > &mt):
-  TVector<TVector<T> >(mt) {}
+// Блок C[I][J] произведения: строки i блока ib, столбцы j блока jb
+// (блоки по MATRIX_BLOCK_SIZE), C[i][j] = сумма A[i][k] * B[k][j] по
+// i <= k <= j. Блок делится на блоки микроядра SIMD_TILE_ROWS x nr (полоса
+// A на полосу B), которые микроядро держит в регистрах; результат
+// накапливается в локальном плотном блоке acc. Диапазон k проходится
+// панелями глубиной MATRIX_PANEL_DEPTH: отрезок полосы B остаётся в кэше
+// L1, пока по нему проходят все полосы A блока. Блоки микроядра ниже
+// диагонали и участки k, где A или B нулевые, пропускаются. Каждый элемент
+// C суммируется по возрастанию k. Границы строк упакованной C не выровнены
+// по строкам кэша, и соседние блоки (в других потоках) делят строки кэша на
+// краях, поэтому в C готовый блок записывается один раз в конце. Буферы
+// tile и acc у каждого потока свои, выделяются при первом вызове в потоке
+// и используются всеми его блоками.
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::MulTile(const T *ap, const T *bp, int nr, T *c, int ib, int jb) const
+{
+	const int MR = SIMD_TILE_ROWS;
+	int n = this->Size;
+	int i0 = ib * MATRIX_BLOCK_SIZE, i1 = min(i0 + MATRIX_BLOCK_SIZE, n);
+	int j0 = jb * MATRIX_BLOCK_SIZE, j1 = min(j0 + MATRIX_BLOCK_SIZE, n);
+	const int B = MATRIX_BLOCK_SIZE;
+	static thread_local TVector<T> scratch(0);
+	if (scratch.GetSize() < MR * nr + B * B) scratch = TVector<T>(MR * nr + B * B);
+	T *tile = scratch.pVector, *acc = tile + MR * nr; // acc[(i - i0) * B + j - j0] - C[i][j]
+	fill(acc, acc + B * B, T());
+	for (int kk = i0; kk < j1; kk += MATRIX_PANEL_DEPTH)
+	{
+		int kend = min(kk + MATRIX_PANEL_DEPTH, j1);
+		for (int p = j0 / nr; p * nr < j1; p++)
+		{
+			int c0 = p * nr;
+			const T *b = bp + PanelOffset(nr, p); // b[k * nr + q] = B[k][c0 + q]
+			for (int s = i0 / MR; s * MR < i1; s++)
+			{
+				int r0 = s * MR;
+				int kfrom = max(kk, r0), kto = min(kend, c0 + nr);
+				if (kfrom >= kto) continue; // блок ниже диагонали или вне панели
+				const T *a = ap + StripOffset(n, s) - r0 * MR; // a[k * MR + r] = A[r0 + r][k]
+				SimdTile(a + kfrom * MR, b + kfrom * nr, tile, kto - kfrom, nr);
+				for (int i = max(r0, i0); i < min(r0 + MR, i1); i++)
+				{
+					T *ci = acc + (i - i0) * B - j0;
+					const T *ti = tile + (i - r0) * nr - c0; // ti[j] - вклад в C[i][j]
+					for (int j = max(max(c0, j0), i); j < min(c0 + nr, j1); j++)
+					{
+						ci[j] += ti[j];
+					}
+				}
+			}
+		}
+	}
+	for (int i = i0; i < i1; i++)
+	{
+		const T *ai = acc + (i - i0) * B - j0;
+		int from = max(j0, i);
+		if (from < j1) copy(ai + from, ai + j1, c + RowOffset(n, i) - i + from);
+	}
+} /*-------------------------------------------------------------------------*/
 
-template <class T> // сравнение
-bool TMatrix<T>::operator==(const TMatrix<T> &mt) const
-{ // при создании матрицы startIndex будет 0 (он является потомком класса вектора)
-	if (Size != mt.Size) return false;
-	for (int i = 0; i < Size; i++) {
-		//if (*this[i] != mt[i]) return false;
-		if (this->pVector[i] != mt.pVector[i]) return false;
+template <class T, class Alloc> // умножение
+TMatrix<T, Alloc> TMatrix<T, Alloc>::operator*(const TMatrix<T, Alloc> &mt) const
+{
+	// Нижние половины нулевые и не участвуют, всего около n^3/6 умножений.
+	// Множители упаковываются в полосы (PackStrip, PackPanel), затем
+	// треугольник C делится на блоки (ib, jb), ib <= jb; работа блока
+	// пропорциональна jb - ib + 1, поэтому блоки раздаются потокам
+	// динамически (ParallelTasks), начиная с самых дальних от диагонали.
+	// Порядок сложений в каждом элементе не зависит от числа потоков.
+	// С порогом GetParallelThreshold() сравнивается число умножений.
+	if (this->Size != mt.Size) throw - 1;
+	int n = this->Size;
+	TMatrix tmp(n);
+	const int MR = SIMD_TILE_ROWS, nr = SimdTileCols<T>();
+	int strips = (n + MR - 1) / MR, panels = (n + nr - 1) / nr;
+	TVector<T> ap(StripOffset(n, strips)), bp(panels > 0 ? PanelOffset(nr, panels - 1) + n * nr : 0);
+	int nb = (n + MATRIX_BLOCK_SIZE - 1) / MATRIX_BLOCK_SIZE;
+	vector<pair<int, int> > tiles;
+	tiles.reserve(nb * (nb + 1) / 2);
+	for (int d = nb - 1; d >= 0; d--)
+	{
+		for (int ib = 0; ib + d < nb; ib++)
+		{
+			tiles.push_back(make_pair(ib, ib + d));
+		}
 	}
-	return true;
+	T *a = ap.pVector, *b = bp.pVector, *c = tmp.pData;
+	auto pack = [this, &mt, a, b, nr, strips](int t) {
+		if (t < strips)
+			PackStrip(a, t);
+		else
+			mt.PackPanel(b, nr, t - strips);
+	};
+	auto tile = [this, a, b, nr, c, &tiles](int t) { MulTile(a, b, nr, c, tiles[t].first, tiles[t].second); };
+	if ((long long)n * n * n / 6 < GetParallelThreshold()) {
+		for (int t = 0; t < strips + panels; t++)
+		{
+			pack(t);
+		}
+		for (int t = 0; t < (int)tiles.size(); t++)
+		{
+			tile(t);
+		}
+	}
+	else {
+		ParallelTasks(strips + panels, pack);
+		ParallelTasks((int)tiles.size(), tile);
+	}
+	return tmp;
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // сравнение
-bool TMatrix<T>::operator!=(const TMatrix<T> &mt) const
+template <class T, class Alloc> // решение системы Ux = b
+TVector<T> TMatrix<T, Alloc>::Solve(const TVector<T> &b, int order) const
 {
-	return !(*this == mt);
+	TVector<T> x(b);
+	SolveInPlace(x, order);
+	return x;
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // присваивание
-TMatrix<T>& TMatrix<T>::operator=(const TMatrix<T> &mt)
+template <class T, class Alloc> // решение системы Ux = b на месте
+void TMatrix<T, Alloc>::SolveInPlace(TVector<T> &b, int order) const
 {
-	if (this == &mt) return *this;
-	if (Size != mt.Size) {
-		delete[] pVector;
-		Size = mt.Size;
-		pVector = new TVector<T>[Size];
+	if (b.Size != this->Size) throw - 1;
+	T *x = b.pVector;
+	SolveBlocked(&x, 1, order);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // решение системы Ux = b в представлении
+void TMatrix<T, Alloc>::SolveInPlace(TVectorView<T> b, int order) const
+{
+	if (b.Size != this->Size) throw - 1;
+	T *x = b.pData;
+	SolveBlocked(&x, 1, order);
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // решение для нескольких правых частей
+TVector<TVector<T> > TMatrix<T, Alloc>::Solve(const TVector<TVector<T> > &B, int order) const
+{
+	TVector<TVector<T> > X(B);
+	SolveInPlace(X, order);
+	return X;
+} /*-------------------------------------------------------------------------*/
+
+template <class T, class Alloc> // решение для нескольких правых частей на месте
+void TMatrix<T, Alloc>::SolveInPlace(TVector<TVector<T> > &B, int order) const
+{
+	int m = B.Size;
+	for (int r = 0; r < m; r++)
+	{
+		if (B.pVector[r].Size != this->Size) throw - 1;
 	}
-	for (int i = 0; i < Size; i++)
+	TVector<T*> xs(m);
+	for (int r = 0; r < m; r++)
 	{
-		pVector[i] = mt.pVector[i];
+		xs.pVector[r] = B.pVector[r].pVector;
 	}
-	return *this;
+	SolveBlocked(xs.pVector, m, order);
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // сложение
-TMatrix<T> TMatrix<T>::operator+(const TMatrix<T> &mt)
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::SolveBlocked(T **xs, int m, int order) const
 {
-	return TVector<TVector<T>>::operator+(mt);
+	// Обратная подстановка блоками по MATRIX_BLOCK_SIZE строк снизу вверх.
+	// Строки упакованы подряд, поэтому обе схемы сводятся к скалярным
+	// произведениям отрезков строк U на уже найденную часть x; каждый
+	// элемент U читается один раз, отрезок x блока остаётся в кэше.
+	// SOLVE_ROWS естественна для упаковки по строкам и используется по
+	// умолчанию; SOLVE_COLUMNS обновляет все строки выше после каждого блока.
+	// Внутренний цикл идёт по правым частям xs[0..m): отрезок строки U
+	// (не длиннее блока) читается из памяти один раз для всех правых частей.
+	// Большие системы решаются в пуле потоков в заданном порядке:
+	// SOLVE_COLUMNS - по графу блоков (SolveGraph), SOLVE_ROWS - строки
+	// каждого блока учитывают найденные x параллельно, частями. Порядок
+	// сложений в каждом элементе x тот же, что и без потоков.
+	int n = this->Size;
+	const int B = MATRIX_BLOCK_SIZE;
+	int threads = n > B && PackedSize(n) >= GetParallelThreshold() ? GetParallelThreads() : 1;
+	if (threads > 1 && order == SOLVE_COLUMNS) {
+		SolveGraph(xs, m);
+		return;
+	}
+	for (int iend = n; iend > 0; )
+	{
+		int ib = max(iend - B, 0);
+		if (order == SOLVE_ROWS && iend < n)
+		{
+			ParallelParts(iend - ib, 1, threads, [this, xs, m, n, ib, iend](int, int from, int to) {
+				for (int jb = iend; jb < n; jb += MATRIX_BLOCK_SIZE)
+				{
+					int len = min(MATRIX_BLOCK_SIZE, n - jb);
+					for (int i = ib + from; i < ib + to; i++)
+					{
+						const T *u = pData + RowOffset(n, i) - i + jb; // u[j] = U[i][jb + j]
+						for (int r = 0; r < m; r++)
+						{
+							xs[r][i] -= SimdDot(u, xs[r] + jb, len);
+						}
+					}
+				}
+			});
+		}
+		for (int i = iend - 1; i >= ib; i--)
+		{
+			const T *u = pData + RowOffset(n, i) - i; // u[j] = U[i][j]
+			if (u[i] == T()) throw - 1; // вырожденная матрица
+			for (int r = 0; r < m; r++)
+			{
+				T *x = xs[r];
+				x[i] = (x[i] - SimdDot(u + i + 1, x + i + 1, iend - i - 1)) / u[i];
+			}
+		}
+		if (order == SOLVE_COLUMNS)
+		{
+			for (int i = 0; i < ib; i++)
+			{
+				const T *u = pData + RowOffset(n, i) - i;
+				for (int r = 0; r < m; r++)
+				{
+					xs[r][i] -= SimdDot(u + ib, xs[r] + ib, iend - ib);
+				}
+			}
+		}
+		iend = ib;
+	}
 } /*-------------------------------------------------------------------------*/
 
-template <class T> // вычитание
-TMatrix<T> TMatrix<T>::operator-(const TMatrix<T> &mt)
+// Параллельная обратная подстановка. Строки делятся на блоки по
+// MATRIX_BLOCK_SIZE снизу вверх, как в SolveBlocked; задачи графа:
+//   D(K)    - решение диагонального блока K (x_K уже учитывает блоки правее);
+//   U(I, K) - вычитание U[I][K] * x_K из x_I, I < K.
+// D(K) ждёт U(K, K + 1); U(I, K) ждёт D(K) и U(I, K + 1), так что обновления
+// каждого x_I идут по порядку K = nb-1..I+1 и результат совпадает с
+// последовательным SOLVE_COLUMNS при любом числе потоков. После D(K)
+// обновления разных блоков I выполняются параллельно; U(K - 1, K) лежит на
+// критическом пути и ставится в очередь последней, чтобы выполниться первой.
+template <class T, class Alloc>
+void TMatrix<T, Alloc>::SolveGraph(T **xs, int m) const
 {
-	return TVector <TVector<T>>::operator-(mt);
+	struct TGraph
+	{
+		const TMatrix &Mat;
+		T **Xs;
+		int M, N, NB;
+		vector<atomic<int> > Wait; // Wait[I * NB + K] - число невыполненных предшественников U(I, K)
+		TTaskGroup Group;
+
+		TGraph(const TMatrix &mt, T **xs, int m):
+		  Mat(mt), Xs(xs), M(m), N(mt.Size), NB((N + MATRIX_BLOCK_SIZE - 1) / MATRIX_BLOCK_SIZE),
+		  Wait(NB * NB)
+		{
+			for (int I = 0; I < NB; I++)
+				for (int K = I + 1; K < NB; K++)
+					Wait[I * NB + K] = K + 1 < NB ? 2 : 1;
+		}
+		int Begin(int K) const { return max(N - (NB - K) * MATRIX_BLOCK_SIZE, 0); }
+		int End(int K) const   { return N - (NB - 1 - K) * MATRIX_BLOCK_SIZE; }
+		void Release(int I, int K)
+		{
+			if (--Wait[I * NB + K] == 0)
+				Group.Run([this, I, K]() { Update(I, K); });
+		}
+		void Solve(int K)
+		{
+			int ib = Begin(K), iend = End(K);
+			for (int i = iend - 1; i >= ib; i--)
+			{
+				const T *u = Mat.pData + RowOffset(N, i) - i; // u[j] = U[i][j]
+				if (u[i] == T()) throw - 1; // вырожденная матрица
+				for (int r = 0; r < M; r++)
+				{
+					T *x = Xs[r];
+					x[i] = (x[i] - SimdDot(u + i + 1, x + i + 1, iend - i - 1)) / u[i];
+				}
+			}
+			for (int I = 0; I < K; I++)
+			{
+				Release(I, K);
+			}
+		}
+		void Update(int I, int K)
+		{
+			int kb = Begin(K), len = End(K) - kb;
+			for (int i = Begin(I); i < End(I); i++)
+			{
+				const T *u = Mat.pData + RowOffset(N, i) - i + kb; // u[j] = U[i][kb + j]
+				for (int r = 0; r < M; r++)
+				{
+					Xs[r][i] -= SimdDot(u, Xs[r] + kb, len);
+				}
+			}
+			if (K - 1 > I)
+				Release(I, K - 1);
+			else
+				Solve(I);
+		}
+	};
+	TGraph graph(*this, xs, m);
+	graph.Solve(graph.NB - 1);
+	graph.Group.Wait();
 } /*-------------------------------------------------------------------------*/
 
 // TVector О3 Л2 П4 С6
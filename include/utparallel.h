@@ -0,0 +1,483 @@
+// ННГУ, ВМК, Курс "Методы программирования-2", С++, ООП
+//
+// utparallel.h
+//
+// Параллельное выполнение операций библиотеки.
+//
+// TThreadPool - общий для библиотеки пул потоков с перехватом задач
+// (work stealing): у каждого рабочего потока своя очередь, задачи, порождённые
+// в рабочем потоке, кладутся в его очередь, свободные потоки забирают задачи
+// из чужих очередей. Ожидающий завершения группы задач поток (в том числе
+// рабочий) сам выполняет задачи из очередей, поэтому вложенный параллелизм
+// (операция, вызванная из задачи пула) не создаёт новых потоков и не
+// блокирует пул.
+//
+// Число потоков (вместе с вызывающим) задаётся SetParallelThreads или
+// переменной окружения UT_NUM_THREADS, по умолчанию - число ядер. Пул
+// пересоздаётся только тогда, когда им не пользуется ни одна группа задач.
+//
+// ParallelRange / ParallelSum делят диапазон индексов [0, n) на равные по
+// числу элементов части; для малых диапазонов (меньше порога) работа
+// выполняется в вызывающем потоке. ParallelTasks раздаёт потокам задачи
+// разного объёма по мере их освобождения.
+
+#ifndef __UTPARALLEL_H__
+#define __UTPARALLEL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// порог по умолчанию: меньше стольких элементов операция не делится
+const int PARALLEL_THRESHOLD = 1 << 18;
+
+inline int& ParallelThresholdRef()
+{
+	static int threshold = PARALLEL_THRESHOLD;
+	return threshold;
+} /*-------------------------------------------------------------------------*/
+
+// наименьшее число элементов, начиная с которого операция делится на потоки
+inline int GetParallelThreshold()
+{
+	return ParallelThresholdRef();
+} /*-------------------------------------------------------------------------*/
+
+inline void SetParallelThreshold(int n)
+{
+	ParallelThresholdRef() = n > 1 ? n : 1;
+} /*-------------------------------------------------------------------------*/
+
+// число потоков по умолчанию: UT_NUM_THREADS или число ядер
+inline int DetectParallelThreads()
+{
+	if (const char *env = std::getenv("UT_NUM_THREADS"))
+	{
+		int n = std::atoi(env);
+		if (n > 0) return n;
+	}
+	int n = (int)std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+} /*-------------------------------------------------------------------------*/
+
+class TThreadPool
+{
+	struct TQueue
+	{
+		std::mutex Lock;
+		std::deque<std::function<void()> > Tasks;
+	};
+
+	std::vector<std::unique_ptr<TQueue> > Queues; // очереди рабочих потоков и общая (последняя)
+	std::vector<std::thread> Workers;
+	std::mutex SleepLock;
+	std::condition_variable Wake;
+	std::atomic<int> Pending;                      // число задач в очередях
+	bool Stop;
+	int WorkerCount;
+	int Users;                                     // число живых групп задач (под InstanceLock)
+
+	// номер рабочего потока пула для текущего потока (-1 - не рабочий)
+	static int& WorkerIndex()
+	{
+		static thread_local int index = -1;
+		return index;
+	}
+	bool Pop(int q, bool back, std::function<void()> &task);
+	void Work(int index);
+public:
+	TThreadPool(int workers);
+	~TThreadPool();
+
+	int GetWorkers() const { return WorkerCount; }
+	static bool InWorker() { return WorkerIndex() >= 0; }
+
+	void Submit(std::function<void()> task);       // поставить задачу в очередь
+	bool RunOne();                                 // выполнить одну задачу из очередей, если есть
+	template <class P>
+	void WaitUntil(P done);                        // выполнять задачи из очередей, пока не done()
+	void Notify();                                 // условие ожидающих WaitUntil могло измениться
+
+	static TThreadPool& Instance();                // пул библиотеки
+	static int Threads();                          // число его потоков вместе с вызывающим
+	static void Restart(int workers);              // пересоздать пул библиотеки
+private:
+	friend class TTaskGroup;
+	static TThreadPool& Acquire();                 // пул библиотеки для группы задач
+	static void Release(TThreadPool &pool);
+	static TThreadPool& Current();                 // пул библиотеки, создаётся при первом вызове (под InstanceLock)
+	static std::unique_ptr<TThreadPool>& InstanceRef()
+	{
+		static std::unique_ptr<TThreadPool> pool;
+		return pool;
+	}
+	static std::mutex& InstanceLock()
+	{
+		static std::mutex lock;
+		return lock;
+	}
+	// пулом библиотеки перестали пользоваться группы задач
+	static std::condition_variable& InstanceIdle()
+	{
+		static std::condition_variable idle;
+		return idle;
+	}
+	// Threads() без блокировки (0 - пул ещё не создан)
+	static std::atomic<int>& ThreadCount()
+	{
+		static std::atomic<int> count(0);
+		return count;
+	}
+	// число живых групп задач, созданных текущим потоком
+	static int& HeldGroups()
+	{
+		static thread_local int count = 0;
+		return count;
+	}
+};
+
+inline TThreadPool::TThreadPool(int workers):
+  Pending(0), Stop(false), WorkerCount(workers > 0 ? workers : 0), Users(0)
+{
+	workers = WorkerCount;
+	for (int i = 0; i <= workers; i++)
+	{
+		Queues.push_back(std::unique_ptr<TQueue>(new TQueue));
+	}
+	for (int i = 0; i < workers; i++)
+	{
+		Workers.push_back(std::thread(&TThreadPool::Work, this, i));
+	}
+} /*-------------------------------------------------------------------------*/
+
+inline TThreadPool::~TThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(SleepLock);
+		Stop = true;
+	}
+	Wake.notify_all();
+	for (size_t i = 0; i < Workers.size(); i++)
+	{
+		Workers[i].join();
+	}
+} /*-------------------------------------------------------------------------*/
+
+inline bool TThreadPool::Pop(int q, bool back, std::function<void()> &task)
+{
+	TQueue &queue = *Queues[q];
+	std::lock_guard<std::mutex> lock(queue.Lock);
+	if (queue.Tasks.empty()) return false;
+	if (back) {
+		task = std::move(queue.Tasks.back());
+		queue.Tasks.pop_back();
+	}
+	else {
+		task = std::move(queue.Tasks.front());
+		queue.Tasks.pop_front();
+	}
+	Pending--;
+	return true;
+} /*-------------------------------------------------------------------------*/
+
+inline void TThreadPool::Submit(std::function<void()> task)
+{
+	int self = WorkerIndex();
+	TQueue &queue = *Queues[self >= 0 && self < GetWorkers() ? self : GetWorkers()];
+	{
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		queue.Tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock(SleepLock);
+		Pending++;
+	}
+	Wake.notify_one();
+} /*-------------------------------------------------------------------------*/
+
+// Своя очередь берётся с конца (последняя порождённая задача, данные ещё
+// в кэше), чужие - с начала (самые крупные, ранние задачи).
+inline bool TThreadPool::RunOne()
+{
+	std::function<void()> task;
+	int q = (int)Queues.size();
+	int self = WorkerIndex();
+	if (self < 0 || self >= GetWorkers()) self = q - 1;
+	bool found = Pop(self, true, task);
+	for (int k = 1; k < q && !found; k++)
+	{
+		found = Pop((self + k) % q, false, task);
+	}
+	if (found) task();
+	return found;
+} /*-------------------------------------------------------------------------*/
+
+// Ожидающий поток сам выполняет задачи, а когда очереди пусты - спит до
+// появления задач или до Notify.
+template <class P>
+void TThreadPool::WaitUntil(P done)
+{
+	while (!done())
+	{
+		if (RunOne()) continue;
+		std::unique_lock<std::mutex> lock(SleepLock);
+		Wake.wait(lock, [this, &done]() { return Stop || Pending > 0 || done(); });
+	}
+} /*-------------------------------------------------------------------------*/
+
+// Вызывается после изменения условия; блокировка SleepLock гарантирует, что
+// поток, проверивший условие до изменения, уже ждёт и будет разбужен.
+inline void TThreadPool::Notify()
+{
+	{
+		std::lock_guard<std::mutex> lock(SleepLock);
+	}
+	Wake.notify_all();
+} /*-------------------------------------------------------------------------*/
+
+inline void TThreadPool::Work(int index)
+{
+	WorkerIndex() = index;
+	for (;;)
+	{
+		if (RunOne()) continue;
+		std::unique_lock<std::mutex> lock(SleepLock);
+		Wake.wait(lock, [this]() { return Stop || Pending > 0; });
+		if (Stop) break;
+	}
+} /*-------------------------------------------------------------------------*/
+
+inline TThreadPool& TThreadPool::Current()
+{
+	std::unique_ptr<TThreadPool> &pool = InstanceRef();
+	if (!pool) {
+		pool.reset(new TThreadPool(DetectParallelThreads() - 1));
+		ThreadCount() = pool->GetWorkers() + 1;
+	}
+	return *pool;
+} /*-------------------------------------------------------------------------*/
+
+// Ссылка действительна до следующего Restart; группы задач пользуются
+// пулом через Acquire.
+inline TThreadPool& TThreadPool::Instance()
+{
+	std::lock_guard<std::mutex> lock(InstanceLock());
+	return Current();
+} /*-------------------------------------------------------------------------*/
+
+inline int TThreadPool::Threads()
+{
+	int n = ThreadCount();
+	return n > 0 ? n : Instance().GetWorkers() + 1;
+} /*-------------------------------------------------------------------------*/
+
+// Пока пул захвачен группой задач, Restart его не уничтожает.
+inline TThreadPool& TThreadPool::Acquire()
+{
+	std::lock_guard<std::mutex> lock(InstanceLock());
+	TThreadPool &pool = Current();
+	pool.Users++;
+	HeldGroups()++;
+	return pool;
+} /*-------------------------------------------------------------------------*/
+
+inline void TThreadPool::Release(TThreadPool &pool)
+{
+	HeldGroups()--;
+	std::lock_guard<std::mutex> lock(InstanceLock());
+	if (--pool.Users == 0) InstanceIdle().notify_all();
+} /*-------------------------------------------------------------------------*/
+
+// Пул пересоздаётся, когда им не пользуется ни одна группа задач: вызов
+// ждёт завершения параллельных операций других потоков. Из задачи пула или
+// при живой группе задач текущего потока это ожидание не закончилось бы,
+// поэтому такой вызов - ошибка.
+inline void TThreadPool::Restart(int workers)
+{
+	std::unique_lock<std::mutex> lock(InstanceLock());
+	std::unique_ptr<TThreadPool> &pool = InstanceRef();
+	if (pool && pool->GetWorkers() == (workers > 0 ? workers : 0)) return;
+	if (InWorker() || HeldGroups() > 0) throw - 1;
+	InstanceIdle().wait(lock, [&pool]() { return !pool || pool->Users == 0; });
+	ThreadCount() = 0;
+	pool.reset();
+	pool.reset(new TThreadPool(workers));
+	ThreadCount() = pool->GetWorkers() + 1;
+} /*-------------------------------------------------------------------------*/
+
+// число потоков, на которое делится операция (без блокировок)
+inline int GetParallelThreads()
+{
+	return TThreadPool::Threads();
+} /*-------------------------------------------------------------------------*/
+
+// Можно вызывать одновременно с параллельными операциями других потоков:
+// пул пересоздаётся после их завершения. Из задачи пула или из функции,
+// выполняемой параллельной операцией, - исключение.
+inline void SetParallelThreads(int n)
+{
+	TThreadPool::Restart(n > 1 ? n - 1 : 0);
+} /*-------------------------------------------------------------------------*/
+
+// Группа задач пула: Run ставит задачу в очередь, Wait ждёт завершения
+// всех задач группы, выполняя тем временем задачи из очередей (а когда их
+// нет - засыпая), и пробрасывает первое исключение из задач.
+class TTaskGroup
+{
+	TThreadPool &Pool;
+	std::atomic<int> Count;
+	std::mutex ErrorLock;
+	std::exception_ptr Error;
+
+	TTaskGroup(const TTaskGroup&);
+	TTaskGroup& operator=(const TTaskGroup&);
+public:
+	TTaskGroup(): Pool(TThreadPool::Acquire()), Count(0) {}
+	~TTaskGroup();
+
+	template <class F>
+	void Run(F f);
+	void Wait();
+};
+
+template <class F>
+void TTaskGroup::Run(F f)
+{
+	Count++;
+	Pool.Submit([this, f]() {
+		TThreadPool &pool = Pool; // после последнего Count-- группа может быть уже уничтожена
+		try {
+			f();
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(ErrorLock);
+			if (!Error) Error = std::current_exception();
+		}
+		if (--Count == 0) pool.Notify();
+	});
+} /*-------------------------------------------------------------------------*/
+
+inline TTaskGroup::~TTaskGroup()
+{
+	Pool.WaitUntil([this]() { return Count == 0; });
+	TThreadPool::Release(Pool);
+} /*-------------------------------------------------------------------------*/
+
+inline void TTaskGroup::Wait()
+{
+	Pool.WaitUntil([this]() { return Count == 0; });
+	if (Error) {
+		std::exception_ptr e = Error;
+		Error = std::exception_ptr();
+		std::rethrow_exception(e);
+	}
+} /*-------------------------------------------------------------------------*/
+
+// Выполнение f(part, from, to) над частями [0, n), part = 0..parts-1.
+// Границы частей кратны grain (например, числу элементов в строке кэша,
+// чтобы потоки не писали в одну строку), части различаются по размеру не
+// больше чем на grain. Частей не больше maxParts. Возвращает число частей.
+template <class F>
+int ParallelParts(int n, int grain, int maxParts, F f)
+{
+	if (grain < 1) grain = 1;
+	int blocks = (n + grain - 1) / grain;
+	int parts = maxParts < blocks ? maxParts : blocks;
+	if (parts < 2) {
+		if (n > 0) f(0, 0, n);
+		return n > 0 ? 1 : 0;
+	}
+	TTaskGroup group;
+	for (int p = 1; p < parts; p++)
+	{
+		int from = (int)((long long)blocks * p / parts) * grain;
+		int to = p + 1 < parts ? (int)((long long)blocks * (p + 1) / parts) * grain : n;
+		group.Run([&f, p, from, to]() { f(p, from, to); });
+	}
+	try {
+		f(0, 0, (int)((long long)blocks / parts) * grain);
+	}
+	catch (...) {
+		group.Wait(); // задачи ссылаются на f, дождаться их
+		throw;
+	}
+	group.Wait();
+	return parts;
+} /*-------------------------------------------------------------------------*/
+
+// То же, частей - по числу потоков (для малых n - одна).
+template <class F>
+int ParallelParts(int n, int grain, F f)
+{
+	return ParallelParts(n, grain, n < GetParallelThreshold() ? 1 : GetParallelThreads(), f);
+} /*-------------------------------------------------------------------------*/
+
+// Выполнение f(from, to) над частями [0, n) (см. ParallelParts).
+template <class F>
+void ParallelRange(int n, int grain, F f)
+{
+	ParallelParts(n, grain, [&f](int, int from, int to) { f(from, to); });
+} /*-------------------------------------------------------------------------*/
+
+// Сумма f(from, to) по частям [0, n). Частичные суммы складываются в
+// порядке частей, поэтому при одном числе потоков результат один и тот же.
+// Число потоков читается один раз: SetParallelThreads из другого потока не
+// должен дать частей больше, чем места под частичные суммы.
+template <class T, class F>
+T ParallelSum(int n, int grain, F f)
+{
+	if (n < GetParallelThreshold()) return n > 0 ? f(0, n) : T(0);
+	int threads = GetParallelThreads();
+	std::vector<T> sums(threads, T(0));
+	int parts = ParallelParts(n, grain, threads, [&f, &sums](int p, int from, int to) { sums[p] = f(from, to); });
+	T sum = T(0);
+	for (int p = 0; p < parts; p++)
+	{
+		sum += sums[p];
+	}
+	return sum;
+} /*-------------------------------------------------------------------------*/
+
+// Выполнение f(t) для t = 0..count-1: каждый поток берёт следующий ещё не
+// взятый номер, как только освободится (динамическое распределение для
+// задач разного объёма; крупные задачи выгодно ставить первыми).
+template <class F>
+void ParallelTasks(int count, F f)
+{
+	int parts = GetParallelThreads();
+	if (parts > count) parts = count;
+	std::atomic<int> next(0);
+	auto work = [&f, &next, count]() {
+		for (int t = next++; t < count; t = next++)
+		{
+			f(t);
+		}
+	};
+	if (parts < 2) {
+		work();
+		return;
+	}
+	TTaskGroup group;
+	for (int p = 1; p < parts; p++)
+	{
+		group.Run(work);
+	}
+	try {
+		work();
+	}
+	catch (...) {
+		next = count; // остальные задачи не начинать
+		group.Wait();
+		throw;
+	}
+	group.Wait();
+} /*-------------------------------------------------------------------------*/
+
+#endif
@@ -0,0 +1,641 @@
+// ННГУ, ВМК, Курс "Методы программирования-2", С++, ООП
+//
+// utsimd.h
+//
+// Векторизованные поэлементные ядра для TVector и TMatrix (SSE2, AVX2,
+// AVX-512) с выбором набора команд по cpuid при первом обращении.
+// Поддерживаются float, double и 32/64-битные целые; для остальных типов
+// и на не-x86 платформах работает обычный скалярный цикл.
+
+#ifndef __UTSIMD_H__
+#define __UTSIMD_H__
+
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define UT_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// компилятор MSVC разрешает интринсики без флагов, GCC и Clang - только в
+// функциях, помеченных нужным набором команд
+#if defined(UT_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define UT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define UT_TARGET(isa)
+#endif
+
+// наборы команд в порядке возрастания ширины
+enum TSimdLevel { SIMD_NONE, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512 };
+
+// поэлементные операции
+enum TSimdOp { SIMD_ADD, SIMD_SUB, SIMD_MUL };
+
+// блок микроядра умножения матриц SimdTile: число строк и число столбцов
+// для типов без векторного ядра
+const int SIMD_TILE_ROWS = 4;
+const int SIMD_TILE_COLS = 8;
+
+inline int DetectSimdLevel()
+{
+#if defined(UT_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SIMD_SSE2;
+	return SIMD_NONE;
+#elif defined(UT_SIMD_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!sse2) return SIMD_NONE;
+	if (!osxsave || maxLeaf < 7) return SIMD_SSE2;
+	unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+	bool avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 17)) != 0 &&
+	              (xcr0 & 0xE6) == 0xE6;
+	if (avx512) return SIMD_AVX512;
+	if (avx2) return SIMD_AVX2;
+	return SIMD_SSE2;
+#else
+	return SIMD_NONE;
+#endif
+} /*-------------------------------------------------------------------------*/
+
+// есть ли FMA (используется в скалярном произведении на уровне AVX2;
+// в AVX-512 FMA входит в базовый набор)
+inline bool DetectSimdFma()
+{
+#if defined(UT_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("fma") != 0;
+#elif defined(UT_SIMD_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 12)) != 0 && (info[2] & (1 << 27)) != 0 &&
+	       (_xgetbv(0) & 0x6) == 0x6;
+#else
+	return false;
+#endif
+} /*-------------------------------------------------------------------------*/
+
+inline bool SimdHasFma()
+{
+	static const bool fma = DetectSimdFma();
+	return fma;
+} /*-------------------------------------------------------------------------*/
+
+inline int& SimdLevelRef()
+{
+	static int level = DetectSimdLevel();
+	return level;
+} /*-------------------------------------------------------------------------*/
+
+// текущий набор команд
+inline int GetSimdLevel()
+{
+	return SimdLevelRef();
+} /*-------------------------------------------------------------------------*/
+
+// ограничить набор команд (не выше поддерживаемого процессором)
+inline void SetSimdLevel(int level)
+{
+	int max = DetectSimdLevel();
+	SimdLevelRef() = level < max ? level : max;
+} /*-------------------------------------------------------------------------*/
+
+// тип, которым ядро обрабатывает элементы T (void - ядра нет)
+template <class T>
+struct TSimdKind
+{
+  static const bool IsInt = std::is_integral<T>::value && !std::is_same<T, bool>::value;
+  typedef typename std::conditional<
+    std::is_same<T, float>::value || std::is_same<T, double>::value, T,
+    typename std::conditional<IsInt && sizeof(T) == 4, int32_t,
+    typename std::conditional<IsInt && sizeof(T) == 8, int64_t,
+    void>::type>::type>::type type;
+};
+
+#ifdef UT_SIMD_X86
+
+// Операции над регистрами для каждого набора команд и типа элементов.
+// Mul при HasMul == false не вызывается (нет такой инструкции).
+template <class K> struct TSse2Ops;
+template <class K> struct TAvx2Ops;
+template <class K> struct TAvx2FmaOps;
+template <class K> struct TAvx512Ops;
+
+#define UT_SIMD_OPS(NAME, ISA, K, REG, WIDTH, HASMUL, LOAD, STORE, SET1, ADD, SUB, MUL, MULADD) \
+template <> struct NAME<K>                                                       \
+{                                                                                \
+  typedef REG Reg;                                                               \
+  static const int Width = WIDTH;                                                \
+  static const bool HasMul = HASMUL;                                             \
+  UT_TARGET(ISA) static Reg Load(const K *p)       { return LOAD(p);     }      \
+  UT_TARGET(ISA) static void Store(K *p, Reg x)    { STORE(p, x);        }      \
+  UT_TARGET(ISA) static Reg Set1(K s)              { return SET1(s);     }      \
+  UT_TARGET(ISA) static Reg Add(Reg x, Reg y)      { return ADD(x, y);   }      \
+  UT_TARGET(ISA) static Reg Sub(Reg x, Reg y)      { return SUB(x, y);   }      \
+  UT_TARGET(ISA) static Reg Mul(Reg x, Reg y)      { return MUL(x, y);   }      \
+  UT_TARGET(ISA) static Reg MulAdd(Reg x, Reg y, Reg acc)                        \
+  { return MULADD(x, y, acc, ADD, MUL); }                                        \
+};
+
+#define UT_NO_MUL(x, y) ((void)(y), (x))
+#define UT_MULADD(x, y, acc, ADD, MUL) ADD(acc, MUL(x, y))
+#define UT_FMA256_PS(x, y, acc, ADD, MUL) _mm256_fmadd_ps(x, y, acc)
+#define UT_FMA256_PD(x, y, acc, ADD, MUL) _mm256_fmadd_pd(x, y, acc)
+#define UT_FMA512_PS(x, y, acc, ADD, MUL) _mm512_fmadd_ps(x, y, acc)
+#define UT_FMA512_PD(x, y, acc, ADD, MUL) _mm512_fmadd_pd(x, y, acc)
+#define UT_SSE_LOADI(p)     _mm_loadu_si128((const __m128i*)(p))
+#define UT_SSE_STOREI(p, x) _mm_storeu_si128((__m128i*)(p), x)
+#define UT_AVX_LOADI(p)     _mm256_loadu_si256((const __m256i*)(p))
+#define UT_AVX_STOREI(p, x) _mm256_storeu_si256((__m256i*)(p), x)
+#define UT_AVX512_LOADI(p)     _mm512_loadu_si512((const void*)(p))
+#define UT_AVX512_STOREI(p, x) _mm512_storeu_si512((void*)(p), x)
+
+UT_SIMD_OPS(TSse2Ops, "sse2", float,   __m128,  4, true,  _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps,     _mm_add_ps,    _mm_sub_ps,    _mm_mul_ps, UT_MULADD)
+UT_SIMD_OPS(TSse2Ops, "sse2", double,  __m128d, 2, true,  _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd,     _mm_add_pd,    _mm_sub_pd,    _mm_mul_pd, UT_MULADD)
+UT_SIMD_OPS(TSse2Ops, "sse2", int32_t, __m128i, 4, false, UT_SSE_LOADI, UT_SSE_STOREI, _mm_set1_epi32,  _mm_add_epi32, _mm_sub_epi32, UT_NO_MUL, UT_MULADD)
+UT_SIMD_OPS(TSse2Ops, "sse2", int64_t, __m128i, 2, false, UT_SSE_LOADI, UT_SSE_STOREI, _mm_set1_epi64x, _mm_add_epi64, _mm_sub_epi64, UT_NO_MUL, UT_MULADD)
+
+UT_SIMD_OPS(TAvx2Ops, "avx2", float,   __m256,  8, true,  _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps,     _mm256_add_ps,    _mm256_sub_ps,    _mm256_mul_ps, UT_MULADD)
+UT_SIMD_OPS(TAvx2Ops, "avx2", double,  __m256d, 4, true,  _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd,     _mm256_add_pd,    _mm256_sub_pd,    _mm256_mul_pd, UT_MULADD)
+UT_SIMD_OPS(TAvx2Ops, "avx2", int32_t, __m256i, 8, true,  UT_AVX_LOADI,    UT_AVX_STOREI,    _mm256_set1_epi32,  _mm256_add_epi32, _mm256_sub_epi32, _mm256_mullo_epi32, UT_MULADD)
+UT_SIMD_OPS(TAvx2Ops, "avx2", int64_t, __m256i, 4, false, UT_AVX_LOADI,    UT_AVX_STOREI,    _mm256_set1_epi64x, _mm256_add_epi64, _mm256_sub_epi64, UT_NO_MUL, UT_MULADD)
+
+UT_SIMD_OPS(TAvx2FmaOps, "avx2,fma", float,  __m256,  8, true, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, UT_FMA256_PS)
+UT_SIMD_OPS(TAvx2FmaOps, "avx2,fma", double, __m256d, 4, true, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, UT_FMA256_PD)
+
+UT_SIMD_OPS(TAvx512Ops, "avx512f,avx512dq", float,   __m512,  16, true, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_set1_ps,    _mm512_add_ps,    _mm512_sub_ps,    _mm512_mul_ps, UT_FMA512_PS)
+UT_SIMD_OPS(TAvx512Ops, "avx512f,avx512dq", double,  __m512d,  8, true, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd,    _mm512_add_pd,    _mm512_sub_pd,    _mm512_mul_pd, UT_FMA512_PD)
+UT_SIMD_OPS(TAvx512Ops, "avx512f,avx512dq", int32_t, __m512i, 16, true, UT_AVX512_LOADI, UT_AVX512_STOREI, _mm512_set1_epi32, _mm512_add_epi32, _mm512_sub_epi32, _mm512_mullo_epi32, UT_MULADD)
+UT_SIMD_OPS(TAvx512Ops, "avx512f,avx512dq", int64_t, __m512i,  8, true, UT_AVX512_LOADI, UT_AVX512_STOREI, _mm512_set1_epi64, _mm512_add_epi64, _mm512_sub_epi64, _mm512_mullo_epi64, UT_MULADD)
+
+// Циклы ядер: c[k] = a[k] op b[k] и c[k] = a[k] op s. Возвращают число
+// обработанных элементов (кратно ширине регистра), хвост досчитывает
+// вызывающий. Каждый набор команд - отдельная функция со своим атрибутом.
+#define UT_SIMD_LOOPS(PREFIX, ISA)                                               \
+template <class V, int Op, class K>                                              \
+UT_TARGET(ISA) inline int PREFIX##Binary(const K *a, const K *b, K *c, int n)   \
+{                                                                                \
+  if (Op == SIMD_MUL && !V::HasMul) return 0;                                    \
+  int k = 0;                                                                     \
+  for (; k + V::Width <= n; k += V::Width)                                       \
+  {                                                                              \
+    typename V::Reg x = V::Load(a + k), y = V::Load(b + k);                      \
+    V::Store(c + k, Op == SIMD_ADD ? V::Add(x, y) :                              \
+                    Op == SIMD_SUB ? V::Sub(x, y) : V::Mul(x, y));               \
+  }                                                                              \
+  return k;                                                                      \
+}                                                                                \
+template <class V, int Op, class K>                                              \
+UT_TARGET(ISA) inline int PREFIX##Scalar(const K *a, K s, K *c, int n)          \
+{                                                                                \
+  if (Op == SIMD_MUL && !V::HasMul) return 0;                                    \
+  typename V::Reg y = V::Set1(s);                                                \
+  int k = 0;                                                                     \
+  for (; k + V::Width <= n; k += V::Width)                                       \
+  {                                                                              \
+    typename V::Reg x = V::Load(a + k);                                          \
+    V::Store(c + k, Op == SIMD_ADD ? V::Add(x, y) :                              \
+                    Op == SIMD_SUB ? V::Sub(x, y) : V::Mul(x, y));               \
+  }                                                                              \
+  return k;                                                                      \
+}
+
+// Скалярное произведение: четыре независимых аккумулятора скрывают
+// задержку сложения (цепочки не ждут друг друга); в sum добавляется
+// сумма обработанной части, возвращается число обработанных элементов.
+#define UT_SIMD_DOT(PREFIX, ISA)                                                 \
+template <class V, class K>                                                      \
+UT_TARGET(ISA) inline int PREFIX##Dot(const K *a, const K *b, int n, K &sum)    \
+{                                                                                \
+  if (!V::HasMul) return 0;                                                      \
+  const int W = V::Width;                                                        \
+  typename V::Reg acc0 = V::Set1(0), acc1 = acc0, acc2 = acc0, acc3 = acc0;      \
+  int k = 0;                                                                     \
+  for (; k + 4 * W <= n; k += 4 * W)                                             \
+  {                                                                              \
+    acc0 = V::MulAdd(V::Load(a + k),         V::Load(b + k),         acc0);      \
+    acc1 = V::MulAdd(V::Load(a + k + W),     V::Load(b + k + W),     acc1);      \
+    acc2 = V::MulAdd(V::Load(a + k + 2 * W), V::Load(b + k + 2 * W), acc2);      \
+    acc3 = V::MulAdd(V::Load(a + k + 3 * W), V::Load(b + k + 3 * W), acc3);      \
+  }                                                                              \
+  for (; k + W <= n; k += W)                                                     \
+  {                                                                              \
+    acc0 = V::MulAdd(V::Load(a + k), V::Load(b + k), acc0);                      \
+  }                                                                              \
+  acc0 = V::Add(V::Add(acc0, acc1), V::Add(acc2, acc3));                         \
+  K lanes[W];                                                                    \
+  V::Store(lanes, acc0);                                                         \
+  for (int i = 0; i < W; i++)                                                    \
+    sum += lanes[i];                                                             \
+  return k;                                                                      \
+}
+
+// Поэлементное накопление c[k] += a[k] * b[k] (ядро пакетных операций).
+#define UT_SIMD_MULADD(PREFIX, ISA)                                              \
+template <class V, class K>                                                      \
+UT_TARGET(ISA) inline int PREFIX##MulAdd(const K *a, const K *b, K *c, int n)   \
+{                                                                                \
+  if (!V::HasMul) return 0;                                                      \
+  int k = 0;                                                                     \
+  for (; k + V::Width <= n; k += V::Width)                                       \
+  {                                                                              \
+    V::Store(c + k, V::MulAdd(V::Load(a + k), V::Load(b + k), V::Load(c + k)));  \
+  }                                                                              \
+  return k;                                                                      \
+}
+
+// Микроядро умножения матриц: блок C из SIMD_TILE_ROWS строк и двух
+// регистров (2 * Width столбцов) целиком держится в регистрах-аккумуляторах,
+// c[r][j] = сумма a[k][r] * b[k][j] по k = 0..kc-1. Панели a и b упакованы
+// вызывающим: a[k] - SIMD_TILE_ROWS элементов столбца k, b[k] - строка k
+// ширины блока. На шаг k - две загрузки b и четыре рассылки a на восемь
+// умножений-сложений. Результат записывается в c (строки подряд).
+#define UT_SIMD_TILE(PREFIX, ISA)                                                \
+template <class V, class K>                                                      \
+UT_TARGET(ISA) inline void PREFIX##Tile(const K *a, const K *b, K *c, int kc)   \
+{                                                                                \
+  const int W = V::Width;                                                        \
+  typename V::Reg c00 = V::Set1(0), c01 = c00, c10 = c00, c11 = c00,             \
+                  c20 = c00, c21 = c00, c30 = c00, c31 = c00;                    \
+  for (int k = 0; k < kc; k++, a += SIMD_TILE_ROWS, b += 2 * W)                  \
+  {                                                                              \
+    typename V::Reg b0 = V::Load(b), b1 = V::Load(b + W), x;                     \
+    x = V::Set1(a[0]); c00 = V::MulAdd(x, b0, c00); c01 = V::MulAdd(x, b1, c01); \
+    x = V::Set1(a[1]); c10 = V::MulAdd(x, b0, c10); c11 = V::MulAdd(x, b1, c11); \
+    x = V::Set1(a[2]); c20 = V::MulAdd(x, b0, c20); c21 = V::MulAdd(x, b1, c21); \
+    x = V::Set1(a[3]); c30 = V::MulAdd(x, b0, c30); c31 = V::MulAdd(x, b1, c31); \
+  }                                                                              \
+  V::Store(c, c00);         V::Store(c + W, c01);                                \
+  V::Store(c + 2 * W, c10); V::Store(c + 3 * W, c11);                            \
+  V::Store(c + 4 * W, c20); V::Store(c + 5 * W, c21);                            \
+  V::Store(c + 6 * W, c30); V::Store(c + 7 * W, c31);                            \
+}
+
+UT_SIMD_LOOPS(Sse2, "sse2")
+UT_SIMD_LOOPS(Avx2, "avx2")
+UT_SIMD_LOOPS(Avx512, "avx512f,avx512dq")
+UT_SIMD_DOT(Sse2, "sse2")
+UT_SIMD_DOT(Avx2, "avx2")
+UT_SIMD_DOT(Avx2Fma, "avx2,fma")
+UT_SIMD_DOT(Avx512, "avx512f,avx512dq")
+UT_SIMD_MULADD(Sse2, "sse2")
+UT_SIMD_MULADD(Avx2, "avx2")
+UT_SIMD_MULADD(Avx2Fma, "avx2,fma")
+UT_SIMD_MULADD(Avx512, "avx512f,avx512dq")
+UT_SIMD_TILE(Sse2, "sse2")
+UT_SIMD_TILE(Avx2, "avx2")
+UT_SIMD_TILE(Avx2Fma, "avx2,fma")
+UT_SIMD_TILE(Avx512, "avx512f,avx512dq")
+
+#undef UT_SIMD_TILE
+#undef UT_SIMD_MULADD
+#undef UT_SIMD_DOT
+#undef UT_SIMD_LOOPS
+#undef UT_SIMD_OPS
+
+template <int Op, class K>
+inline int SimdBinaryKernel(const K *a, const K *b, K *c, int n)
+{
+	switch (GetSimdLevel())
+	{
+	case SIMD_AVX512: return Avx512Binary<TAvx512Ops<K>, Op>(a, b, c, n);
+	case SIMD_AVX2:   return Avx2Binary<TAvx2Ops<K>, Op>(a, b, c, n);
+	case SIMD_SSE2:   return Sse2Binary<TSse2Ops<K>, Op>(a, b, c, n);
+	default:          return 0;
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <int Op, class K>
+inline int SimdScalarKernel(const K *a, K s, K *c, int n)
+{
+	switch (GetSimdLevel())
+	{
+	case SIMD_AVX512: return Avx512Scalar<TAvx512Ops<K>, Op>(a, s, c, n);
+	case SIMD_AVX2:   return Avx2Scalar<TAvx2Ops<K>, Op>(a, s, c, n);
+	case SIMD_SSE2:   return Sse2Scalar<TSse2Ops<K>, Op>(a, s, c, n);
+	default:          return 0;
+	}
+} /*-------------------------------------------------------------------------*/
+
+// FMA-вариант на уровне AVX2 есть только для float и double
+template <class K>
+inline int SimdDotAvx2(const K *a, const K *b, int n, K &sum)
+{
+	return Avx2Dot<TAvx2Ops<K> >(a, b, n, sum);
+} /*-------------------------------------------------------------------------*/
+
+inline int SimdDotAvx2(const float *a, const float *b, int n, float &sum)
+{
+	if (SimdHasFma()) return Avx2FmaDot<TAvx2FmaOps<float> >(a, b, n, sum);
+	return Avx2Dot<TAvx2Ops<float> >(a, b, n, sum);
+} /*-------------------------------------------------------------------------*/
+
+inline int SimdDotAvx2(const double *a, const double *b, int n, double &sum)
+{
+	if (SimdHasFma()) return Avx2FmaDot<TAvx2FmaOps<double> >(a, b, n, sum);
+	return Avx2Dot<TAvx2Ops<double> >(a, b, n, sum);
+} /*-------------------------------------------------------------------------*/
+
+template <class K>
+inline int SimdDotKernel(const K *a, const K *b, int n, K &sum)
+{
+	switch (GetSimdLevel())
+	{
+	case SIMD_AVX512: return Avx512Dot<TAvx512Ops<K> >(a, b, n, sum);
+	case SIMD_AVX2:   return SimdDotAvx2(a, b, n, sum);
+	case SIMD_SSE2:   return Sse2Dot<TSse2Ops<K> >(a, b, n, sum);
+	default:          return 0;
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class K>
+inline int SimdMulAddAvx2(const K *a, const K *b, K *c, int n)
+{
+	return Avx2MulAdd<TAvx2Ops<K> >(a, b, c, n);
+} /*-------------------------------------------------------------------------*/
+
+inline int SimdMulAddAvx2(const float *a, const float *b, float *c, int n)
+{
+	if (SimdHasFma()) return Avx2FmaMulAdd<TAvx2FmaOps<float> >(a, b, c, n);
+	return Avx2MulAdd<TAvx2Ops<float> >(a, b, c, n);
+} /*-------------------------------------------------------------------------*/
+
+inline int SimdMulAddAvx2(const double *a, const double *b, double *c, int n)
+{
+	if (SimdHasFma()) return Avx2FmaMulAdd<TAvx2FmaOps<double> >(a, b, c, n);
+	return Avx2MulAdd<TAvx2Ops<double> >(a, b, c, n);
+} /*-------------------------------------------------------------------------*/
+
+template <class K>
+inline int SimdMulAddKernel(const K *a, const K *b, K *c, int n)
+{
+	switch (GetSimdLevel())
+	{
+	case SIMD_AVX512: return Avx512MulAdd<TAvx512Ops<K> >(a, b, c, n);
+	case SIMD_AVX2:   return SimdMulAddAvx2(a, b, c, n);
+	case SIMD_SSE2:   return Sse2MulAdd<TSse2Ops<K> >(a, b, c, n);
+	default:          return 0;
+	}
+} /*-------------------------------------------------------------------------*/
+
+// ширина блока микроядра (два регистра), 0 - нет умножения
+template <class V>
+inline int SimdTileWidth()
+{
+	return V::HasMul ? 2 * V::Width : 0;
+} /*-------------------------------------------------------------------------*/
+
+template <class K>
+inline int SimdTileColsKernel()
+{
+	switch (GetSimdLevel())
+	{
+	case SIMD_AVX512: return SimdTileWidth<TAvx512Ops<K> >();
+	case SIMD_AVX2:   return SimdTileWidth<TAvx2Ops<K> >();
+	case SIMD_SSE2:   return SimdTileWidth<TSse2Ops<K> >();
+	default:          return 0;
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class K>
+inline void SimdTileAvx2(const K *a, const K *b, K *c, int kc)
+{
+	Avx2Tile<TAvx2Ops<K> >(a, b, c, kc);
+} /*-------------------------------------------------------------------------*/
+
+inline void SimdTileAvx2(const float *a, const float *b, float *c, int kc)
+{
+	if (SimdHasFma()) Avx2FmaTile<TAvx2FmaOps<float> >(a, b, c, kc);
+	else Avx2Tile<TAvx2Ops<float> >(a, b, c, kc);
+} /*-------------------------------------------------------------------------*/
+
+inline void SimdTileAvx2(const double *a, const double *b, double *c, int kc)
+{
+	if (SimdHasFma()) Avx2FmaTile<TAvx2FmaOps<double> >(a, b, c, kc);
+	else Avx2Tile<TAvx2Ops<double> >(a, b, c, kc);
+} /*-------------------------------------------------------------------------*/
+
+// false - панели упакованы не под ширину ядра текущего уровня
+template <class K>
+inline bool SimdTileKernel(const K *a, const K *b, K *c, int kc, int nr)
+{
+	if (nr == 0 || nr != SimdTileColsKernel<K>()) return false;
+	switch (GetSimdLevel())
+	{
+	case SIMD_AVX512: Avx512Tile<TAvx512Ops<K> >(a, b, c, kc); return true;
+	case SIMD_AVX2:   SimdTileAvx2(a, b, c, kc);                return true;
+	case SIMD_SSE2:   Sse2Tile<TSse2Ops<K> >(a, b, c, kc);     return true;
+	default:          return false;
+	}
+} /*-------------------------------------------------------------------------*/
+
+#endif // UT_SIMD_X86
+
+// выбор ядра: K = void - ядра для типа нет
+template <int Op, class K, class T>
+inline int SimdBinaryDispatch(const T *a, const T *b, T *c, int n, K*)
+{
+#ifdef UT_SIMD_X86
+	return SimdBinaryKernel<Op>((const K*)a, (const K*)b, (K*)c, n);
+#else
+	return 0;
+#endif
+} /*-------------------------------------------------------------------------*/
+
+template <int Op, class T>
+inline int SimdBinaryDispatch(const T*, const T*, T*, int, void*)
+{
+	return 0;
+} /*-------------------------------------------------------------------------*/
+
+template <int Op, class K, class T>
+inline int SimdScalarDispatch(const T *a, const T &s, T *c, int n, K*)
+{
+#ifdef UT_SIMD_X86
+	return SimdScalarKernel<Op>((const K*)a, (K)s, (K*)c, n);
+#else
+	return 0;
+#endif
+} /*-------------------------------------------------------------------------*/
+
+template <int Op, class T>
+inline int SimdScalarDispatch(const T*, const T&, T*, int, void*)
+{
+	return 0;
+} /*-------------------------------------------------------------------------*/
+
+// скалярная операция для хвоста и типов без ядра
+template <int Op> struct TSimdApply;
+template <> struct TSimdApply<SIMD_ADD>
+{
+  template <class A, class B> static void Apply(A &c, const A &a, const B &b) { c = a + b; }
+};
+template <> struct TSimdApply<SIMD_SUB>
+{
+  template <class A, class B> static void Apply(A &c, const A &a, const B &b) { c = a - b; }
+};
+template <> struct TSimdApply<SIMD_MUL>
+{
+  template <class A, class B> static void Apply(A &c, const A &a, const B &b) { c = a * b; }
+};
+
+// c[k] = a[k] op b[k], k = 0..n-1; c может совпадать с a или b
+template <int Op, class T>
+void SimdBinary(const T *a, const T *b, T *c, int n)
+{
+	int k = SimdBinaryDispatch<Op>(a, b, c, n, (typename TSimdKind<T>::type*)0);
+	for (; k < n; k++)
+	{
+		TSimdApply<Op>::Apply(c[k], a[k], b[k]);
+	}
+} /*-------------------------------------------------------------------------*/
+
+// c[k] = a[k] op s, k = 0..n-1; c может совпадать с a
+template <int Op, class T>
+void SimdScalar(const T *a, const T &s, T *c, int n)
+{
+	int k = SimdScalarDispatch<Op>(a, s, c, n, (typename TSimdKind<T>::type*)0);
+	for (; k < n; k++)
+	{
+		TSimdApply<Op>::Apply(c[k], a[k], s);
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class K, class T>
+inline int SimdDotDispatch(const T *a, const T *b, int n, T &sum, K*)
+{
+#ifdef UT_SIMD_X86
+	K part = 0;
+	int k = SimdDotKernel((const K*)a, (const K*)b, n, part);
+	sum += (T)part;
+	return k;
+#else
+	return 0;
+#endif
+} /*-------------------------------------------------------------------------*/
+
+template <class T>
+inline int SimdDotDispatch(const T*, const T*, int, T&, void*)
+{
+	return 0;
+} /*-------------------------------------------------------------------------*/
+
+template <class K, class T>
+inline int SimdMulAddDispatch(const T *a, const T *b, T *c, int n, K*)
+{
+#ifdef UT_SIMD_X86
+	return SimdMulAddKernel((const K*)a, (const K*)b, (K*)c, n);
+#else
+	return 0;
+#endif
+} /*-------------------------------------------------------------------------*/
+
+template <class T>
+inline int SimdMulAddDispatch(const T*, const T*, T*, int, void*)
+{
+	return 0;
+} /*-------------------------------------------------------------------------*/
+
+// c[k] += a[k] * b[k], k = 0..n-1; c не пересекается с a и b
+template <class T>
+void SimdMulAdd(const T *a, const T *b, T *c, int n)
+{
+	int k = SimdMulAddDispatch(a, b, c, n, (typename TSimdKind<T>::type*)0);
+	for (; k < n; k++)
+	{
+		c[k] += a[k] * b[k];
+	}
+} /*-------------------------------------------------------------------------*/
+
+template <class K>
+inline int SimdTileColsDispatch(K*)
+{
+#ifdef UT_SIMD_X86
+	return SimdTileColsKernel<K>();
+#else
+	return 0;
+#endif
+} /*-------------------------------------------------------------------------*/
+
+inline int SimdTileColsDispatch(void*)
+{
+	return 0;
+} /*-------------------------------------------------------------------------*/
+
+template <class K, class T>
+inline bool SimdTileDispatch(const T *a, const T *b, T *c, int kc, int nr, K*)
+{
+#ifdef UT_SIMD_X86
+	return SimdTileKernel((const K*)a, (const K*)b, (K*)c, kc, nr);
+#else
+	return false;
+#endif
+} /*-------------------------------------------------------------------------*/
+
+template <class T>
+inline bool SimdTileDispatch(const T*, const T*, T*, int, int, void*)
+{
+	return false;
+} /*-------------------------------------------------------------------------*/
+
+// число столбцов блока микроядра SimdTile для T на текущем наборе команд
+template <class T>
+int SimdTileCols()
+{
+	int nr = SimdTileColsDispatch((typename TSimdKind<T>::type*)0);
+	return nr > 0 ? nr : SIMD_TILE_COLS;
+} /*-------------------------------------------------------------------------*/
+
+// Блок SIMD_TILE_ROWS x nr произведения упакованных панелей:
+// c[r * nr + j] = сумма a[k * SIMD_TILE_ROWS + r] * b[k * nr + j], k = 0..kc-1.
+// nr - значение SimdTileCols<T>(), с которым упакована панель b; если
+// векторного ядра такой ширины нет, блок считается обычным циклом.
+template <class T>
+void SimdTile(const T *a, const T *b, T *c, int kc, int nr)
+{
+	if (SimdTileDispatch(a, b, c, kc, nr, (typename TSimdKind<T>::type*)0)) return;
+	for (int k = 0; k < SIMD_TILE_ROWS * nr; k++)
+	{
+		c[k] = T();
+	}
+	for (int k = 0; k < kc; k++, a += SIMD_TILE_ROWS, b += nr)
+	{
+		for (int r = 0; r < SIMD_TILE_ROWS; r++)
+		{
+			for (int j = 0; j < nr; j++)
+			{
+				c[r * nr + j] += a[r] * b[j];
+			}
+		}
+	}
+} /*-------------------------------------------------------------------------*/
+
+// сумма a[k] * b[k], k = 0..n-1
+template <class T>
+T SimdDot(const T *a, const T *b, int n)
+{
+	T sum = 0;
+	int k = SimdDotDispatch(a, b, n, sum, (typename TSimdKind<T>::type*)0);
+	for (; k < n; k++)
+	{
+		sum += a[k] * b[k];
+	}
+	return sum;
+} /*-------------------------------------------------------------------------*/
+
+#endif
@@ -0,0 +1,76 @@
+// ННГУ, ВМК, Курс "Методы программирования-2", С++, ООП
+//
+// bench_batch.cpp
+//
+// Пакетные операции над малыми матрицами: время на одну матрицу для
+// отдельных объектов TMatrix<double> и для TMatrixBatch<double> (сложение,
+// умножение, решение системы) при размерах 4..32.
+// Необязательный аргумент - число матриц в пакете (по умолчанию 4096).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "utbatch.h"
+//---------------------------------------------------------------------------
+
+// время одного вызова f в наносекундах (лучшее из нескольких повторов)
+template <class F>
+double Measure(F f)
+{
+  double best = 1e300;
+  for (int r = 0; r < 5; r++)
+  {
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    f();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t).count();
+    if (ns < best) best = ns;
+  }
+  return best;
+}
+
+int main(int argc, char **argv)
+{
+  int count = argc > 1 ? atoi(argv[1]) : 4096;
+  volatile double sink = 0;
+
+  printf("count %d, SIMD level %d, threads %d\n", count, GetSimdLevel(), GetParallelThreads());
+  printf("%4s %4s %12s %12s %8s\n", "n", "op", "single ns", "batch ns", "speedup");
+  for (int n = 4; n <= 32; n *= 2)
+  {
+    vector<TMatrix<double> > a(count, TMatrix<double>(n)), b(count, TMatrix<double>(n));
+    vector<TVector<double> > rhs(count, TVector<double>(n));
+    TMatrixBatch<double> ba(n, count), bb(n, count);
+    TVectorBatch<double> brhs(n, count);
+    for (int k = 0; k < count; k++)
+    {
+      for (int i = 0; i < n; i++)
+      {
+        for (int j = i; j < n; j++)
+        {
+          a[k](i, j) = i == j ? 2.0 + k % 3 : 1.0 / (j - i + k % 5 + 1);
+          b[k](i, j) = (i + j + k) % 7 - 3;
+        }
+        rhs[k][i] = i + k % 4;
+      }
+      ba.Set(k, a[k]);
+      bb.Set(k, b[k]);
+      brhs.Set(k, rhs[k]);
+    }
+
+    double single[3], batch[3];
+    single[0] = Measure([&]() { for (int k = 0; k < count; k++) { TMatrix<double> c(a[k] + b[k]); sink = sink + c(0, 0); } });
+    batch[0] = Measure([&]() { TMatrixBatch<double> c = ba + bb; sink = sink + c(0, 0, 0); });
+    single[1] = Measure([&]() { for (int k = 0; k < count; k++) { TMatrix<double> c = a[k] * b[k]; sink = sink + c(0, 0); } });
+    batch[1] = Measure([&]() { TMatrixBatch<double> c = ba * bb; sink = sink + c(0, 0, 0); });
+    single[2] = Measure([&]() { for (int k = 0; k < count; k++) { TVector<double> x = a[k].Solve(rhs[k]); sink = sink + x[0]; } });
+    batch[2] = Measure([&]() { TVectorBatch<double> x = ba.Solve(brhs); sink = sink + x(0, 0); });
+
+    const char *names[3] = { "add", "mul", "solve" };
+    for (int op = 0; op < 3; op++)
+      printf("%4d %4s %12.1f %12.1f %8.2f\n", n, names[op], single[op] / count, batch[op] / count,
+        single[op] / batch[op]);
+  }
+  return 0;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,65 @@
+// ННГУ, ВМК, Курс "Методы программирования-2", С++, ООП
+//
+// bench_dot.cpp
+//
+// Сравнение скорости скалярного произведения TVector::operator*(const TVector&)
+// с последовательным циклом с одним аккумулятором для размеров 1e3..1e8.
+// Необязательный аргумент - наибольший размер (по умолчанию MAX_VECTOR_SIZE).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "utmatrix.h"
+//---------------------------------------------------------------------------
+
+// прежняя реализация: один аккумулятор, цепочка сложений
+double SerialDot(TVector<double> &a, TVector<double> &b)
+{
+  const double *pa = &a[0], *pb = &b[0];
+  double tmp = 0;
+  for (int i = 0; i < a.GetSize(); i++)
+    tmp += pa[i] * pb[i];
+  return tmp;
+}
+
+// время одного вызова f в наносекундах (лучшее из нескольких повторов)
+template <class F>
+double Measure(F f, int n)
+{
+  int reps = 200000000 / n + 1;
+  double best = 1e300;
+  for (int r = 0; r < 3; r++)
+  {
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (int i = 0; i < reps; i++)
+      f();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t).count();
+    if (ns / reps < best) best = ns / reps;
+  }
+  return best;
+}
+
+int main(int argc, char **argv)
+{
+  int maxSize = argc > 1 ? atoi(argv[1]) : MAX_VECTOR_SIZE;
+  volatile double sink = 0;
+
+  printf("SIMD level %d, FMA %d\n", GetSimdLevel(), (int)SimdHasFma());
+  printf("%10s %14s %14s %14s %8s\n", "size", "serial GB/s", "simd GB/s", "simd GFLOP/s", "speedup");
+  for (int n = 1000; n <= maxSize; n *= 10)
+  {
+    TVector<double> a(n), b(n);
+    for (int i = 0; i < n; i++)
+    {
+      a[i] = 1.0 / (i + 1);
+      b[i] = i % 7;
+    }
+    double serial = Measure([&]() { sink = sink + SerialDot(a, b); }, n);
+    double simd = Measure([&]() { sink = sink + a * b; }, n);
+    double bytes = 2.0 * n * sizeof(double);
+    printf("%10d %14.2f %14.2f %14.2f %8.2f\n", n, bytes / serial, bytes / simd,
+      2.0 * n / simd, serial / simd);
+  }
+  return 0;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,90 @@
+// ННГУ, ВМК, Курс "Методы программирования-2", С++, ООП
+//
+// bench_mul.cpp
+//
+// Масштабируемость умножения верхнетреугольных матриц TMatrix<double>
+// по числу потоков: 1, 2, 4, ... и все доступные потоки. Достигнутая
+// скорость сравнивается с пиковой: скоростью микроядра SimdTile на данных
+// из кэша L1, умноженной на число потоков.
+// Необязательный аргумент - размер матриц (по умолчанию 2000).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "utmatrix.h"
+//---------------------------------------------------------------------------
+
+// время одного умножения в секундах (лучшее из нескольких повторов)
+double Measure(const TMatrix<double> &a, const TMatrix<double> &b, TMatrix<double> &c)
+{
+  double best = 1e300;
+  for (int r = 0; r < 3; r++)
+  {
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    c = a * b;
+    double s = chrono::duration<double>(chrono::steady_clock::now() - t).count();
+    if (s < best) best = s;
+  }
+  return best;
+}
+
+// пиковая скорость одного потока в GFLOP/s: микроядро на панелях из кэша L1
+double MeasurePeak()
+{
+  const int kc = 256, reps = 2000, nr = SimdTileCols<double>();
+  vector<double> a(SIMD_TILE_ROWS * kc, 0.5), b(nr * kc, 0.25), c(SIMD_TILE_ROWS * nr);
+  double best = 1e300, sink = 0;
+  for (int r = 0; r < 5; r++)
+  {
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (int k = 0; k < reps; k++)
+    {
+      SimdTile(a.data(), b.data(), c.data(), kc, nr);
+      sink += c[0];
+    }
+    double s = chrono::duration<double>(chrono::steady_clock::now() - t).count();
+    if (s < best) best = s;
+  }
+  if (sink < 0) printf("%g\n", sink);
+  return 2.0 * SIMD_TILE_ROWS * nr * kc * reps / best * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  int n = argc > 1 ? atoi(argv[1]) : 2000;
+  int maxThreads = (int)thread::hardware_concurrency();
+  if (maxThreads < 1) maxThreads = 1;
+
+  TMatrix<double> a(n), b(n), c(n), ref(n);
+  for (int i = 0; i < n; i++)
+    for (int j = i; j < n; j++)
+    {
+      a(i, j) = 1.0 / (i + j + 1);
+      b(i, j) = (i + 2 * j) % 9 - 4;
+    }
+
+  // умножений около n^3/6, операций с плавающей точкой вдвое больше
+  double flops = (double)n * (n + 1) * (n + 2) / 3;
+  double peak = MeasurePeak();
+  printf("n = %d, threads available %d, SIMD level %d, peak %.2f GFLOP/s per thread\n", n, maxThreads,
+    GetSimdLevel(), peak);
+  printf("%8s %10s %10s %8s %10s %10s %6s\n", "threads", "time s", "GFLOP/s", "% peak", "speedup", "effic.",
+    "same");
+  double t1 = 0;
+  for (int p = 1; ; p = p * 2 < maxThreads ? p * 2 : maxThreads)
+  {
+    SetParallelThreads(p);
+    double t = Measure(a, b, c);
+    if (p == 1) {
+      t1 = t;
+      ref = c;
+    }
+    printf("%8d %10.3f %10.2f %8.1f %10.2f %10.2f %6s\n", p, t, flops / t * 1e-9,
+      100 * flops / t * 1e-9 / (peak * p), t1 / t, t1 / t / p, c == ref ? "yes" : "no");
+    if (p == maxThreads) break;
+  }
+  return 0;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,83 @@
+// ННГУ, ВМК, Курс "Методы программирования-2", С++, ООП
+//
+// bench_small.cpp
+//
+// Короткие векторы: сравнение TVector<double> (буфер в куче) с
+// TVector<double, TBoundsCheck, TSmallAlloc<16> > (малый буфер в объекте).
+// Для размеров 1..32 измеряется время и число обращений к куче на одну
+// итерацию "создать два вектора, сложить, скопировать, уничтожить".
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "utmatrix.h"
+//---------------------------------------------------------------------------
+
+static long long Allocations = 0;
+
+void* operator new(size_t size)
+{
+  Allocations++;
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+// одна итерация: результат не даёт компилятору выбросить вычисления
+template <class V>
+double Step(int n, double x)
+{
+  V a(n, 0, x), b(n, 0, 1.0);
+  V c(a + b);
+  V d(c);
+  return d[n - 1];
+}
+
+// время одной итерации в наносекундах (лучшее из нескольких повторов)
+// и число выделений памяти на итерацию
+template <class V>
+void Measure(int n, double &ns, double &allocs)
+{
+  const int reps = 1000000;
+  volatile double sink = 0;
+  ns = 1e300;
+  for (int r = 0; r < 3; r++)
+  {
+    long long a0 = Allocations;
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (int i = 0; i < reps; i++)
+      sink = sink + Step<V>(n, i);
+    double cur = chrono::duration<double, nano>(chrono::steady_clock::now() - t).count() / reps;
+    if (cur < ns) ns = cur;
+    allocs = double(Allocations - a0) / reps;
+  }
+}
+
+int main()
+{
+  typedef TVector<double> THeapVector;
+  typedef TVector<double, TBoundsCheck, TSmallAlloc<16> > TSmallVector;
+
+  printf("sizeof: heap %d, small %d bytes\n", (int)sizeof(THeapVector), (int)sizeof(TSmallVector));
+  printf("%6s %12s %12s %12s %12s %8s\n", "size", "heap ns", "heap allocs", "small ns", "small allocs", "speedup");
+  for (int n = 1; n <= 32; n *= 2)
+  {
+    double hns, hal, sns, sal;
+    Measure<THeapVector>(n, hns, hal);
+    Measure<TSmallVector>(n, sns, sal);
+    printf("%6d %12.1f %12.1f %12.1f %12.1f %8.2f\n", n, hns, hal, sns, sal, hns / sns);
+  }
+  return 0;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,11 @@
+#ifndef __ALLOC_COUNTER_H__
+#define __ALLOC_COUNTER_H__
+
+// Number of heap allocations made through operator new since the last
+// reset; test_main.cpp replaces the global operator new to count them.
+// Atomic because library operations may allocate from pool threads.
+#include <atomic>
+
+extern std::atomic<int> AllocationCount;
+
+#endif
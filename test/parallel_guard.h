@@ -0,0 +1,29 @@
+#ifndef __PARALLEL_GUARD_H__
+#define __PARALLEL_GUARD_H__
+
+// Sets the pool size and the parallel threshold for the lifetime of the
+// guard and restores the previous settings when it goes out of scope, so a
+// failed ASSERT or an exception does not leak them into later tests.
+#include "utparallel.h"
+
+class TParallelGuard
+{
+	int Threads, Threshold;
+
+	TParallelGuard(const TParallelGuard&);
+	TParallelGuard& operator=(const TParallelGuard&);
+public:
+	explicit TParallelGuard(int threads, int threshold = 1):
+	  Threads(GetParallelThreads()), Threshold(GetParallelThreshold())
+	{
+		SetParallelThreshold(threshold);
+		SetParallelThreads(threads);
+	}
+	~TParallelGuard()
+	{
+		SetParallelThreshold(Threshold);
+		SetParallelThreads(Threads);
+	}
+};
+
+#endif
@@ -1,4 +1,29 @@
 #include <gtest.h>
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+std::atomic<int> AllocationCount(0);
+
+void* operator new(std::size_t n)
+{
+  AllocationCount++;
+  void *p = std::malloc(n ? n : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
 
 int main(int argc, char **argv)
 {
@@ -0,0 +1,152 @@
+#include "utbatch.h"
+
+#include <gtest.h>
+#include "parallel_guard.h"
+
+// матрица b пакета: (i, j) -> значение, зависящее от b
+static double BatchValue(int b, int i, int j)
+{
+	return i == j ? 2.0 + (b + i) % 3 : ((b * 7 + i * 3 + j) % 9 - 4) * 0.25;
+}
+
+template <class T>
+static void FillBatch(TMatrixBatch<T> &mb)
+{
+	for (int b = 0; b < mb.GetCount(); b++)
+		for (int i = 0; i < mb.GetSize(); i++)
+			for (int j = i; j < mb.GetSize(); j++)
+				mb(b, i, j) = (T)BatchValue(b, i, j);
+}
+
+TEST(TMatrixBatch, can_create_batch)
+{
+	ASSERT_NO_THROW(TMatrixBatch<double> mb(8, 100));
+}
+
+TEST(TMatrixBatch, cant_create_batch_with_negative_size_or_count)
+{
+	ASSERT_ANY_THROW(TMatrixBatch<double> mb(-1, 10));
+	ASSERT_ANY_THROW(TMatrixBatch<double> mb(4, -1));
+}
+
+TEST(TMatrixBatch, new_batch_is_zero_and_stride_is_cache_line_multiple)
+{
+	TMatrixBatch<double> mb(4, 13);
+	EXPECT_EQ(4, mb.GetSize());
+	EXPECT_EQ(13, mb.GetCount());
+	EXPECT_GE(mb.GetStride(), 13);
+	EXPECT_EQ(0, mb.GetStride() * (int)sizeof(double) % VECTOR_ALIGNMENT);
+	for (int b = 0; b < 13; b++)
+		for (int i = 0; i < 4; i++)
+			for (int j = i; j < 4; j++)
+				EXPECT_EQ(0, mb(b, i, j));
+}
+
+TEST(TMatrixBatch, set_and_get_round_trip)
+{
+	TMatrixBatch<double> mb(5, 20);
+	TMatrix<double> m(5);
+	for (int i = 0; i < 5; i++)
+		for (int j = i; j < 5; j++)
+			m(i, j) = i * 10 + j;
+	mb.Set(7, m);
+	EXPECT_EQ(m, mb.Get(7));
+	EXPECT_EQ(23, mb(7, 2, 3));
+	EXPECT_EQ(0, mb(6, 2, 3));
+	ASSERT_ANY_THROW(mb.Set(7, TMatrix<double>(4)));
+	ASSERT_ANY_THROW(mb.Get(20));
+}
+
+TEST(TMatrixBatch, add_sub_and_multiply_match_tmatrix)
+{
+	const int n = 6, count = 37;
+	TMatrixBatch<double> a(n, count), b(n, count);
+	FillBatch(a);
+	for (int k = 0; k < count; k++)
+		b.Set(k, a.Get((k + 5) % count));
+	TMatrixBatch<double> sum = a + b, diff = a - b, prod = a * b;
+	for (int k = 0; k < count; k++)
+	{
+		TMatrix<double> ma = a.Get(k), mb = b.Get(k);
+		EXPECT_EQ(TMatrix<double>(ma + mb), sum.Get(k));
+		EXPECT_EQ(TMatrix<double>(ma - mb), diff.Get(k));
+		TMatrix<double> mp = ma * mb, bp = prod.Get(k);
+		for (int i = 0; i < n; i++)
+			for (int j = i; j < n; j++)
+				EXPECT_NEAR(mp(i, j), bp(i, j), 1e-12);
+	}
+	a += b;
+	EXPECT_EQ(sum, a);
+	a -= b;
+	a -= b;
+	EXPECT_EQ(diff, a);
+}
+
+TEST(TMatrixBatch, int_multiply_is_exact)
+{
+	const int n = 5, count = 20;
+	TMatrixBatch<int> a(n, count), b(n, count);
+	FillBatch(a);
+	FillBatch(b);
+	TMatrixBatch<int> prod = a * b;
+	for (int k = 0; k < count; k++)
+		EXPECT_EQ(a.Get(k) * b.Get(k), prod.Get(k));
+}
+
+TEST(TMatrixBatch, cant_combine_batches_of_different_shape)
+{
+	TMatrixBatch<double> a(4, 10), b(5, 10), c(4, 11);
+	ASSERT_ANY_THROW(a + b);
+	ASSERT_ANY_THROW(a * c);
+	ASSERT_ANY_THROW(a -= c);
+}
+
+TEST(TMatrixBatch, solve_matches_tmatrix)
+{
+	const int n = 7, count = 29;
+	TMatrixBatch<double> u(n, count);
+	FillBatch(u);
+	TVectorBatch<double> rhs(n, count);
+	for (int k = 0; k < count; k++)
+		for (int i = 0; i < n; i++)
+			rhs(k, i) = (k + i) % 5 - 2;
+	TVectorBatch<double> x = u.Solve(rhs);
+	for (int k = 0; k < count; k++)
+	{
+		TVector<double> ref = u.Get(k).Solve(rhs.Get(k)), got = x.Get(k);
+		for (int i = 0; i < n; i++)
+			EXPECT_NEAR(ref[i], got[i], 1e-12);
+	}
+}
+
+TEST(TMatrixBatch, solve_throws_for_singular_matrix_in_batch)
+{
+	TMatrixBatch<double> u(3, 10);
+	FillBatch(u);
+	u(4, 1, 1) = 0;
+	TVectorBatch<double> rhs(3, 10);
+	ASSERT_ANY_THROW(u.SolveInPlace(rhs));
+	TVectorBatch<double> other(4, 10);
+	ASSERT_ANY_THROW(TMatrixBatch<double>(4, 9).SolveInPlace(other));
+}
+
+TEST(TMatrixBatch, parallel_operations_match_serial)
+{
+	const int n = 8, count = 700;
+	TMatrixBatch<double> a(n, count), b(n, count);
+	FillBatch(a);
+	for (int k = 0; k < count; k++)
+		b.Set(k, a.Get(count - 1 - k));
+	TVectorBatch<double> rhs(n, count);
+	for (int k = 0; k < count; k++)
+		for (int i = 0; i < n; i++)
+			rhs(k, i) = k % 3 + i;
+	TMatrixBatch<double> sum = a + b, prod = a * b;
+	TVectorBatch<double> x = a.Solve(rhs);
+	TParallelGuard guard(4);
+	TMatrixBatch<double> psum = a + b, pprod = a * b;
+	TVectorBatch<double> px = a.Solve(rhs);
+	EXPECT_EQ(sum, psum);
+	EXPECT_EQ(prod, pprod);
+	EXPECT_EQ(x, px);
+}
@@ -1,6 +1,8 @@
 #include "utmatrix.h"
 
 #include <gtest.h>
+#include "alloc_counter.h"
+#include "parallel_guard.h"
 
 TEST(TMatrix, can_create_matrix_with_positive_length)
 {
@@ -225,3 +227,865 @@ TEST(TMatrix, cant_subtract_matrixes_with_not_equal_size)
 	//ADD_FAILURE();
 }
 
+
+TEST(TMatrix, rows_are_packed_into_one_buffer)
+{
+	const int size = 5;
+	TMatrix<int> a(size);
+	for (int i = 0; i < size - 1; i++)
+	{
+		EXPECT_EQ(&a[i][size - 1] + 1, &a[i + 1][i + 1]);
+	}
+}
+
+TEST(TMatrix, row_has_triangular_size_and_start_index)
+{
+	TMatrix<int> a(5);
+	EXPECT_EQ(3, a[2].GetSize());
+	EXPECT_EQ(2, a[2].GetStartIndex());
+}
+
+TEST(TMatrix, cant_change_size_of_matrix_row)
+{
+	TMatrix<int> a(5);
+	ASSERT_ANY_THROW(a[1] = TVector<int>(2));
+}
+
+TEST(TMatrix, can_convert_triangular_vector_of_vectors)
+{
+	const int size = 3;
+	TVector<TVector<int> > v(size);
+	TMatrix<int> testm(size);
+	for (int i = 0; i < size; i++)
+	{
+		v[i] = TVector<int>(size - i, i);
+		for (int j = i; j < size; j++)
+		{
+			v[i][j] = i * 10 + j;
+			testm[i][j] = i * 10 + j;
+		}
+	}
+	EXPECT_EQ(testm, TMatrix<int>(v));
+}
+
+TEST(TMatrix, cant_convert_not_triangular_vector_of_vectors)
+{
+	TVector<TVector<int> > v(3);
+	ASSERT_ANY_THROW(TMatrix<int> m(v));
+}
+
+TEST(TMatrix, move_constructor_takes_memory_of_source)
+{
+	TMatrix<int> m(5);
+	int *p = &m[0][0];
+	TMatrix<int> m1(std::move(m));
+	EXPECT_EQ(p, &m1[0][0]);
+	EXPECT_EQ(0, m.GetSize());
+}
+
+TEST(TMatrix, move_assignment_takes_memory_of_source)
+{
+	TMatrix<int> m(5), m1(3);
+	int *p = &m[0][0];
+	m1 = std::move(m);
+	EXPECT_EQ(p, &m1[0][0]);
+	EXPECT_EQ(5, m1.GetSize());
+}
+
+TEST(TMatrix, assigning_sum_allocates_only_result)
+{
+	TMatrix<int> m1(5), m2(5), res(3);
+	AllocationCount = 0;
+	res = m1 + m2;
+	EXPECT_EQ(1, AllocationCount);
+}
+
+TEST(TMatrix, can_move_vector_of_vectors_into_matrix)
+{
+	TVector<TVector<int> > v(2);
+	v[0] = TVector<int>(2, 0);
+	v[1] = TVector<int>(1, 1);
+	v[0][0] = 1; v[0][1] = 2; v[1][1] = 3;
+	TMatrix<int> m(std::move(v));
+	EXPECT_EQ(1, m[0][0]);
+	EXPECT_EQ(2, m[0][1]);
+	EXPECT_EQ(3, m[1][1]);
+}
+
+TEST(TMatrix, can_evaluate_chain_of_sums_and_differences)
+{
+	const int size = 5;
+	TMatrix<int> m1(size), m2(size), m3(size), m4(size), testm(size);
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			m1[i][j] = i;
+			m2[i][j] = j;
+			m3[i][j] = i * j;
+			m4[i][j] = 7;
+			testm[i][j] = i + j - i * j + 7;
+		}
+	}
+	TMatrix<int> res(m1 + m2 - m3 + m4);
+	EXPECT_EQ(testm, res);
+	EXPECT_TRUE(testm == m1 + m2 - m3 + m4);
+}
+
+TEST(TMatrix, assigning_chain_to_matrix_of_equal_size_does_not_allocate)
+{
+	TMatrix<int> m1(5), m2(5), m3(5), m4(5), res(5);
+	AllocationCount = 0;
+	res = m1 + m2 - m3 + m4;
+	EXPECT_EQ(0, AllocationCount);
+}
+
+TEST(TMatrix, cant_build_chain_with_matrices_of_not_equal_size)
+{
+	TMatrix<int> m1(5), m2(5), m3(2);
+	ASSERT_ANY_THROW(m1 + m2 - m3);
+}
+
+TEST(TMatrix, can_multiply_matrices_with_equal_size)
+{
+	const int size = 3;
+	TMatrix<int> m1(size), m2(size), testm(size);
+	// m1 = [1 2 3; 0 4 5; 0 0 6], m2 = [1 1 1; 0 2 2; 0 0 3]
+	m1[0][0] = 1; m1[0][1] = 2; m1[0][2] = 3;
+	m1[1][1] = 4; m1[1][2] = 5;
+	m1[2][2] = 6;
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			m2[i][j] = i + 1;
+		}
+	}
+	testm[0][0] = 1; testm[0][1] = 5; testm[0][2] = 14;
+	testm[1][1] = 8; testm[1][2] = 23;
+	testm[2][2] = 18;
+	EXPECT_EQ(testm, m1 * m2);
+}
+
+TEST(TMatrix, multiplication_of_large_matrices_matches_naive_product)
+{
+	const int size = 2 * MATRIX_BLOCK_SIZE + 7;
+	TMatrix<int> m1(size), m2(size), testm(size);
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			m1[i][j] = (i + 2 * j) % 7 - 3;
+			m2[i][j] = (3 * i + j) % 5 - 2;
+		}
+	}
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			int sum = 0;
+			for (int k = i; k <= j; k++)
+			{
+				sum += m1[i][k] * m2[k][j];
+			}
+			testm[i][j] = sum;
+		}
+	}
+	EXPECT_EQ(testm, m1 * m2);
+}
+
+TEST(TMatrix, cant_multiply_matrices_with_not_equal_size)
+{
+	TMatrix<int> m1(5), m2(2);
+	ASSERT_ANY_THROW(m1 * m2);
+}
+
+TEST(TMatrix, simd_addition_matches_scalar_results_on_every_level)
+{
+	const int size = 11;
+	TMatrix<double> m1(size), m2(size);
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			m1[i][j] = i * 0.5 + j;
+			m2[i][j] = j - i * 0.25;
+		}
+	}
+	int top = GetSimdLevel();
+	for (int level = SIMD_NONE; level <= top; level++)
+	{
+		SetSimdLevel(level);
+		TMatrix<double> sum(m1 + m2), diff(m1 - m2);
+		for (int i = 0; i < size; i++)
+		{
+			for (int j = i; j < size; j++)
+			{
+				EXPECT_EQ(m1[i][j] + m2[i][j], sum[i][j]);
+				EXPECT_EQ(m1[i][j] - m2[i][j], diff[i][j]);
+			}
+		}
+	}
+	SetSimdLevel(top);
+}
+
+// произведение m1 * m2 на каждом наборе команд совпадает с наивным;
+// значения целые и малые, поэтому сравнение точное и для float, double
+template <class T>
+static void CheckMultiplicationOnEveryLevel(int size)
+{
+	TMatrix<T> m1(size), m2(size), testm(size);
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			m1[i][j] = (T)((i + 2 * j) % 7 - 3);
+			m2[i][j] = (T)((3 * i + j) % 5 - 2);
+		}
+	}
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			T sum = 0;
+			for (int k = i; k <= j; k++)
+			{
+				sum += m1[i][k] * m2[k][j];
+			}
+			testm[i][j] = sum;
+		}
+	}
+	int top = GetSimdLevel();
+	for (int level = SIMD_NONE; level <= top; level++)
+	{
+		SetSimdLevel(level);
+		EXPECT_EQ(testm, m1 * m2) << "level " << level;
+	}
+	SetSimdLevel(top);
+}
+
+TEST(TMatrix, simd_multiplication_matches_naive_product_on_every_level)
+{
+	// несколько панелей по k и неполные блоки микроядра на краях
+	const int size = MATRIX_PANEL_DEPTH + MATRIX_BLOCK_SIZE + 5;
+	CheckMultiplicationOnEveryLevel<double>(size);
+	CheckMultiplicationOnEveryLevel<float>(size);
+	CheckMultiplicationOnEveryLevel<int>(size);
+	CheckMultiplicationOnEveryLevel<short>(37);
+}
+
+TEST(TMatrix, can_solve_triangular_system)
+{
+	// U = [2 1 1; 0 4 2; 0 0 5], x = [1 2 3]
+	TMatrix<double> u(3);
+	u[0][0] = 2; u[0][1] = 1; u[0][2] = 1;
+	u[1][1] = 4; u[1][2] = 2;
+	u[2][2] = 5;
+	TVector<double> b(3), x(3);
+	b[0] = 7; b[1] = 14; b[2] = 15;
+	x[0] = 1; x[1] = 2; x[2] = 3;
+	EXPECT_EQ(x, u.Solve(b));
+	EXPECT_EQ(x, u.Solve(b, SOLVE_COLUMNS));
+}
+
+TEST(TMatrix, solution_of_large_system_satisfies_it_for_both_orders)
+{
+	const int size = 2 * MATRIX_BLOCK_SIZE + 13;
+	TMatrix<double> u(size);
+	TVector<double> b(size);
+	for (int i = 0; i < size; i++)
+	{
+		u[i][i] = size + i;
+		for (int j = i + 1; j < size; j++)
+		{
+			u[i][j] = (i + 2 * j) % 5 - 2;
+		}
+		b[i] = i % 7 - 3;
+	}
+	for (int order = SOLVE_ROWS; order <= SOLVE_COLUMNS; order++)
+	{
+		TVector<double> x = u.Solve(b, order);
+		for (int i = 0; i < size; i++)
+		{
+			double sum = 0;
+			for (int j = i; j < size; j++)
+			{
+				sum += u[i][j] * x[j];
+			}
+			EXPECT_NEAR(b[i], sum, 1e-9);
+		}
+	}
+}
+
+TEST(TMatrix, can_solve_triangular_system_in_place)
+{
+	TMatrix<double> u(2);
+	u[0][0] = 1; u[0][1] = 1;
+	u[1][1] = 2;
+	TVector<double> b(2);
+	b[0] = 3; b[1] = 4;
+	u.SolveInPlace(b);
+	EXPECT_EQ(1, b[0]);
+	EXPECT_EQ(2, b[1]);
+}
+
+TEST(TMatrix, cant_solve_system_with_not_equal_size)
+{
+	TMatrix<double> u(3);
+	TVector<double> b(2);
+	ASSERT_ANY_THROW(u.Solve(b));
+}
+
+TEST(TMatrix, cant_solve_system_with_zero_on_diagonal)
+{
+	TMatrix<double> u(2);
+	u[0][0] = 1; u[0][1] = 1;
+	u[1][1] = 0;
+	TVector<double> b(2);
+	ASSERT_ANY_THROW(u.Solve(b));
+}
+
+TEST(TMatrix, multiple_right_hand_sides_give_same_solutions_as_single_ones)
+{
+	const int size = 2 * MATRIX_BLOCK_SIZE + 13, count = 5;
+	TMatrix<double> u(size);
+	TVector<TVector<double> > b(count);
+	for (int i = 0; i < size; i++)
+	{
+		u[i][i] = size + i;
+		for (int j = i + 1; j < size; j++)
+		{
+			u[i][j] = (i + 2 * j) % 5 - 2;
+		}
+	}
+	for (int r = 0; r < count; r++)
+	{
+		b[r] = TVector<double>(size);
+		for (int i = 0; i < size; i++)
+		{
+			b[r][i] = (i * (r + 1)) % 7 - 3;
+		}
+	}
+	for (int order = SOLVE_ROWS; order <= SOLVE_COLUMNS; order++)
+	{
+		TVector<TVector<double> > x = u.Solve(b, order);
+		for (int r = 0; r < count; r++)
+		{
+			TVector<double> xr = u.Solve(b[r], order);
+			for (int i = 0; i < size; i++)
+			{
+				EXPECT_NEAR(xr[i], x[r][i], 1e-12);
+			}
+		}
+	}
+}
+
+TEST(TMatrix, cant_solve_for_right_hand_sides_with_not_equal_size)
+{
+	TMatrix<double> u(3);
+	TVector<TVector<double> > b(2);
+	b[0] = TVector<double>(3);
+	b[1] = TVector<double>(2);
+	ASSERT_ANY_THROW(u.SolveInPlace(b));
+}
+
+TEST(TMatrix, compound_operators_change_matrix_in_place)
+{
+	const int size = 4;
+	TMatrix<int> m1(size), m2(size), testm(size);
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			m1[i][j] = i + j;
+			m2[i][j] = j;
+			testm[i][j] = (i + j + j - j - j) * 3;
+		}
+	}
+	m1 += m2;
+	m1 -= m2 + m2;
+	m1 *= 3;
+	EXPECT_EQ(testm, m1);
+}
+
+TEST(TMatrix, compound_operators_do_not_allocate)
+{
+	TMatrix<int> m1(5), m2(5);
+	AllocationCount = 0;
+	for (int i = 0; i < 10; i++)
+	{
+		m1 += m2;
+		m1 -= m2 + m2;
+		m1 *= 2;
+	}
+	EXPECT_EQ(0, AllocationCount);
+}
+
+TEST(TMatrix, cant_add_in_place_matrix_with_not_equal_size)
+{
+	TMatrix<int> m1(5), m2(2);
+	ASSERT_ANY_THROW(m1 += m2);
+}
+
+TEST(TMatrix, construction_makes_one_allocation)
+{
+	AllocationCount = 0;
+	TMatrix<int> m(100);
+	EXPECT_EQ(1, AllocationCount);
+	TMatrix<int> m1(m);
+	EXPECT_EQ(2, AllocationCount);
+}
+
+TEST(TMatrix, two_index_access_refers_to_same_element_as_rows)
+{
+	const int size = 6;
+	TMatrix<int> m(size);
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			m(i, j) = i * 10 + j;
+		}
+	}
+	const TMatrix<int> &c = m;
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			EXPECT_EQ(&m[i][j], &m(i, j));
+			EXPECT_EQ(i * 10 + j, c(i, j));
+		}
+	}
+}
+
+TEST(TMatrix, two_index_access_checks_indices_in_debug_build)
+{
+	TMatrix<int> m(4);
+#ifdef NDEBUG
+	EXPECT_FALSE(TDebugBoundsCheck::Enabled);
+#else
+	ASSERT_ANY_THROW(m(2, 1));
+	ASSERT_ANY_THROW(m(-1, 2));
+	ASSERT_ANY_THROW(m(1, 4));
+#endif
+	ASSERT_NO_THROW(m(1, 3));
+}
+
+TEST(TMatrix, matrix_elements_are_aligned)
+{
+	for (int n = 1; n < 20; n++)
+	{
+		TMatrix<double> m(n);
+		EXPECT_EQ(0u, (size_t)&m(0, 0) % VECTOR_ALIGNMENT);
+	}
+}
+
+TEST(TMatrix, assign_to_smaller_matrix_reuses_memory)
+{
+	TMatrix<int> m(8), small(3), big(8);
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = i; j < 3; j++)
+		{
+			small[i][j] = i + j;
+		}
+	}
+	int before = AllocationCount;
+	m = small;
+	EXPECT_EQ(3, m.GetSize());
+	EXPECT_EQ(8, m.GetCapacity());
+	EXPECT_EQ(small, m);
+	m = big;
+	m = small + small;
+	EXPECT_EQ(before, AllocationCount);
+	EXPECT_EQ(small + small, m);
+}
+
+TEST(TMatrix, reserve_keeps_elements)
+{
+	TMatrix<int> m(3);
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = i; j < 3; j++)
+		{
+			m[i][j] = i * 3 + j;
+		}
+	}
+	TMatrix<int> copy(m);
+	m.reserve(10);
+	EXPECT_EQ(10, m.GetCapacity());
+	EXPECT_EQ(copy, m);
+	TMatrix<int> big(10);
+	int before = AllocationCount;
+	m = big;
+	EXPECT_EQ(before, AllocationCount);
+}
+
+TEST(TMatrix, shrink_to_fit_keeps_elements)
+{
+	TMatrix<int> m(6), small(2);
+	small[0][1] = 5;
+	m = small;
+	m.shrink_to_fit();
+	EXPECT_EQ(2, m.GetCapacity());
+	EXPECT_EQ(small, m);
+	EXPECT_EQ(5, m[0][1]);
+}
+
+TEST(TMatrix, pool_allocated_matrix_reuses_freed_block)
+{
+	{
+		TMatrix<double, TPoolAlloc> m(100);
+	}
+	int before = AllocationCount;
+	TMatrix<double, TPoolAlloc> m(100);
+	EXPECT_EQ(before, AllocationCount);
+	EXPECT_EQ(0u, (size_t)&m(0, 0) % VECTOR_ALIGNMENT);
+}
+
+TEST(TMatrix, arena_allocated_matrices_are_carved_from_one_chunk)
+{
+	TArenaScope scope;
+	TMatrix<int, TArenaAlloc> a(20), b(20);
+	for (int i = 0; i < 20; i++)
+	{
+		for (int j = i; j < 20; j++)
+		{
+			a(i, j) = i;
+			b(i, j) = j;
+		}
+	}
+	int before = AllocationCount;
+	for (int k = 0; k < 50; k++)
+	{
+		TMatrix<int, TArenaAlloc> c(a + b);
+		EXPECT_EQ(19 + 19, c(19, 19));
+	}
+	EXPECT_EQ(before, AllocationCount);
+}
+
+TEST(TMatrix, matrices_with_different_allocators_can_be_combined)
+{
+	TMatrix<int, TPoolAlloc> a(5);
+	TMatrix<int> b(5);
+	for (int i = 0; i < 5; i++)
+	{
+		for (int j = i; j < 5; j++)
+		{
+			a(i, j) = 1;
+			b(i, j) = i + j;
+		}
+	}
+	TMatrix<int> c(a + b);
+	EXPECT_EQ(9, c(4, 4));
+	TMatrix<int, TPoolAlloc> d(c - a);
+	EXPECT_TRUE(d == b);
+}
+
+TEST(TMatrix, row_view_refers_to_matrix_elements)
+{
+	TMatrix<int> m(5);
+	for (int i = 0; i < 5; i++)
+	{
+		for (int j = i; j < 5; j++)
+		{
+			m(i, j) = 10 * i + j;
+		}
+	}
+	TVectorView<int> r = m.Row(1, 2, 4);
+	EXPECT_EQ(2, r.GetSize());
+	EXPECT_EQ(12, r[2]);
+	EXPECT_EQ(13, r[3]);
+	r[3] = 0;
+	EXPECT_EQ(0, m(1, 3));
+	ASSERT_ANY_THROW(m.Row(2, 1, 4));
+	ASSERT_ANY_THROW(m.Row(5, 5, 5));
+}
+
+TEST(TMatrix, block_view_refers_to_matrix_elements)
+{
+	TMatrix<int> m(6);
+	for (int i = 0; i < 6; i++)
+	{
+		for (int j = i; j < 6; j++)
+		{
+			m(i, j) = 10 * i + j;
+		}
+	}
+	TMatBlock<int> b = m.Block(0, 3, 3, 6);
+	EXPECT_EQ(3, b.GetRows());
+	EXPECT_EQ(3, b.GetCols());
+	EXPECT_EQ(24, b(2, 4));
+	b(1, 5) = -1;
+	EXPECT_EQ(-1, m(1, 5));
+	TVectorView<int> row = b.Row(2);
+	EXPECT_EQ(3, row.GetStartIndex());
+	EXPECT_EQ(25, row[5]);
+}
+
+TEST(TMatrix, block_times_vector_matches_elementwise_product)
+{
+	const int size = 70;
+	TMatrix<double> m(size);
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = i; j < size; j++)
+		{
+			m(i, j) = (i + 2 * j) % 5;
+		}
+	}
+	TVector<double> x(40);
+	for (int j = 0; j < 40; j++)
+	{
+		x[j] = j % 3;
+	}
+	const TMatrix<double> &cm = m;
+	TVector<double> y = cm.Block(5, 30, 30, 70) * x;
+	EXPECT_EQ(25, y.GetSize());
+	EXPECT_EQ(5, y.GetStartIndex());
+	for (int i = 5; i < 30; i++)
+	{
+		double s = 0;
+		for (int j = 30; j < 70; j++)
+		{
+			s += m(i, j) * x[j - 30];
+		}
+		EXPECT_EQ(s, y[i]);
+	}
+}
+
+TEST(TMatrix, cant_create_block_out_of_range)
+{
+	TMatrix<int> m(6);
+	ASSERT_ANY_THROW(m.Block(0, 3, 3, 7));
+	ASSERT_ANY_THROW(m.Block(4, 3, 0, 6));
+	ASSERT_NO_THROW(m.Block(0, 6, 0, 6));
+}
+
+TEST(TMatrix, block_crossing_diagonal_skips_lower_elements)
+{
+	TMatrix<int> m(6);
+	for (int i = 0; i < 6; i++)
+	{
+		for (int j = i; j < 6; j++)
+		{
+			m(i, j) = 10 * i + j;
+		}
+	}
+	TMatBlock<int> b = m.Block(0, 4, 2, 6);
+	EXPECT_EQ(23, b(2, 3));
+	ASSERT_ANY_THROW(b(3, 2));
+	TVectorView<int> row = b.Row(3); // хранимая часть: столбцы 3..5
+	EXPECT_EQ(3, row.GetStartIndex());
+	EXPECT_EQ(3, row.GetSize());
+	TVector<int> x(4, 0, 1);
+	TVector<int> y = b * x;
+	EXPECT_EQ(2 + 3 + 4 + 5, y[0]);
+	EXPECT_EQ(33 + 34 + 35, y[3]);
+}
+
+TEST(TMatrix, views_of_const_matrix_are_read_only)
+{
+	TMatrix<int> m(4);
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = i; j < 4; j++)
+		{
+			m(i, j) = 1;
+		}
+	}
+	const TMatrix<int> &cm = m;
+	EXPECT_TRUE((is_same<decltype(cm.Block(0, 2, 2, 4)(0, 3)), const int&>::value));
+	EXPECT_TRUE((is_same<decltype(cm.Block(0, 2, 2, 4).Row(0)[2]), const int&>::value));
+	EXPECT_TRUE((is_same<decltype(cm.Row(0, 1, 4)[1]), const int&>::value));
+	EXPECT_TRUE((is_same<decltype(m.Block(0, 2, 2, 4)(0, 3)), int&>::value));
+	TVector<int> r = cm.Row(0, 1, 4); // копия элементов
+	r[1] = 7;
+	EXPECT_EQ(1, m(0, 1));
+	TMatBlock<const int> cb = m.Block(0, 2, 2, 4);
+	EXPECT_EQ(1, cb(1, 3));
+}
+
+TEST(TMatrix, block_operations_change_stored_elements)
+{
+	TMatrix<int> m(6), n(6);
+	for (int i = 0; i < 6; i++)
+	{
+		for (int j = i; j < 6; j++)
+		{
+			m(i, j) = 10 * i + j;
+			n(i, j) = 1;
+		}
+	}
+	TMatBlock<int> d = m.Block(1, 4, 1, 4); // диагональный блок
+	d += n.Block(2, 5, 2, 5);
+	EXPECT_EQ(12, m(1, 1));
+	EXPECT_EQ(14, m(1, 3));
+	EXPECT_EQ(34, m(3, 3));
+	d -= n.Block(0, 3, 0, 3);
+	EXPECT_EQ(11, m(1, 1));
+	m.Block(0, 2, 4, 6) *= 2;
+	EXPECT_EQ(8, m(0, 4));
+	EXPECT_EQ(30, m(1, 5));
+	EXPECT_EQ(3, m(0, 3));
+	m.Block(0, 2, 4, 6) = n.Block(3, 5, 4, 6);
+	EXPECT_EQ(1, m(0, 4));
+	EXPECT_EQ(1, m(1, 5));
+	ASSERT_ANY_THROW(d += n.Block(0, 3, 1, 4)); // другое положение относительно диагонали
+	ASSERT_ANY_THROW(d = n.Block(0, 2, 0, 2));  // другой размер
+}
+
+TEST(TMatrix, diagonal_block_solves_its_system)
+{
+	TMatrix<double> m(5);
+	for (int i = 0; i < 5; i++)
+	{
+		for (int j = i; j < 5; j++)
+		{
+			m(i, j) = i == j ? 2.0 : 1.0 / (j - i + 1);
+		}
+	}
+	const TMatrix<double> &cm = m;
+	TVector<double> rhs(3, 1);
+	rhs[1] = 1; rhs[2] = 2; rhs[3] = 3;
+	TVector<double> x = cm.Block(1, 4, 1, 4).Solve(rhs);
+	for (int i = 1; i < 4; i++)
+	{
+		double s = 0;
+		for (int j = i; j < 4; j++)
+		{
+			s += m(i, j) * x[j];
+		}
+		EXPECT_NEAR(rhs[i], s, 1e-12);
+	}
+	ASSERT_ANY_THROW(m.Block(0, 3, 1, 4).Solve(rhs));
+	ASSERT_ANY_THROW(m.Block(0, 2, 0, 2).Solve(rhs));
+}
+
+TEST(TMatrix, can_solve_with_view_as_right_hand_side)
+{
+	TMatrix<double> m(3);
+	m(0, 0) = 1; m(0, 1) = 2; m(0, 2) = 0;
+	m(1, 1) = 2; m(1, 2) = 1;
+	m(2, 2) = 4;
+	TVector<double> storage(5, 0, 0.0);
+	TVectorView<double> b = storage.View(1, 4);
+	b[1] = 3; b[2] = 4; b[3] = 8; // x = (1, 1, 2)
+	m.SolveInPlace(b);
+	EXPECT_DOUBLE_EQ(1, storage[1]);
+	EXPECT_DOUBLE_EQ(1, storage[2]);
+	EXPECT_DOUBLE_EQ(2, storage[3]);
+	TVector<double> x = m.Solve(m.Row(0, 0, 3));
+	EXPECT_EQ(3, x.GetSize());
+}
+
+TEST(TMatrix, parallel_add_and_sub_match_serial)
+{
+	const int n = 100;
+	TMatrix<double> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = i; j < n; j++)
+		{
+			a(i, j) = i + 0.5 * j;
+			b(i, j) = j - i;
+		}
+	TMatrix<double> sum(a + b), diff(a - b);
+	TParallelGuard guard(3);
+	TMatrix<double> psum(a + b), pdiff(n);
+	pdiff = a - b;
+	TMatrix<double> acc(a);
+	acc += b;
+	acc -= b;
+	EXPECT_EQ(sum, psum);
+	EXPECT_EQ(diff, pdiff);
+	EXPECT_EQ(a, acc);
+}
+
+TEST(TMatrix, multiply_scratch_does_not_depend_on_tile_count)
+{
+	TMatrix<double> a(70), b(300);
+	TMatrix<double> warm(a * a); // рабочие буферы потока выделяются один раз
+	AllocationCount = 0;
+	TMatrix<double> small(a * a);
+	int few = AllocationCount;
+	AllocationCount = 0;
+	TMatrix<double> large(b * b); // 15 блоков вместо 3
+	EXPECT_EQ(few, AllocationCount);
+}
+
+TEST(TMatrix, parallel_multiply_matches_serial)
+{
+	const int n = 150; // три блока MATRIX_BLOCK_SIZE, последний неполный
+	TMatrix<double> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = i; j < n; j++)
+		{
+			a(i, j) = 1.0 / (i + j + 1);
+			b(i, j) = (i * 7 + j) % 5 - 2;
+		}
+	TMatrix<double> serial(a * b);
+	TParallelGuard guard(4);
+	TMatrix<double> parallel(a * b);
+	EXPECT_EQ(serial, parallel);
+	double s = 0;
+	for (int k = 10; k <= 140; k++)
+		s += a(10, k) * b(k, 140);
+	EXPECT_DOUBLE_EQ(s, parallel(10, 140));
+}
+
+TEST(TMatrix, parallel_solve_matches_serial_in_both_orders)
+{
+	const int n = 300;
+	TMatrix<double> m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = i; j < n; j++)
+			m(i, j) = i == j ? 2.0 + i % 3 : 1.0 / (j - i + 1);
+	TVector<double> b(n), b2(n);
+	for (int i = 0; i < n; i++)
+	{
+		b[i] = i % 11 - 5;
+		b2[i] = 1;
+	}
+	TVector<TVector<double> > B(2);
+	B[0] = b;
+	B[1] = b2;
+	TVector<double> serial[2];
+	TVector<TVector<double> > serialB[2];
+	for (int order = SOLVE_ROWS; order <= SOLVE_COLUMNS; order++)
+	{
+		serial[order] = m.Solve(b, order);
+		serialB[order] = m.Solve(B, order);
+	}
+	TParallelGuard guard(4);
+	for (int order = SOLVE_ROWS; order <= SOLVE_COLUMNS; order++)
+	{
+		TVector<double> x = m.Solve(b, order);
+		TVector<TVector<double> > X = m.Solve(B, order);
+		EXPECT_EQ(serial[order], x);
+		EXPECT_EQ(serialB[order][0], X[0]);
+		EXPECT_EQ(serialB[order][1], X[1]);
+		for (int i = 0; i < n; i += 37)
+		{
+			double s = 0;
+			for (int j = i; j < n; j++)
+			{
+				s += m(i, j) * x[j];
+			}
+			EXPECT_NEAR(b[i], s, 1e-9);
+		}
+	}
+	EXPECT_NE(serial[SOLVE_ROWS], serial[SOLVE_COLUMNS]); // порядки действительно различаются
+}
+
+TEST(TMatrix, parallel_solve_throws_for_singular_matrix)
+{
+	const int n = 200;
+	TMatrix<double> m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = i; j < n; j++)
+			m(i, j) = 1;
+	m(10, 10) = 0;
+	TVector<double> b(n, 0, 1.0);
+	TParallelGuard guard(4);
+	EXPECT_ANY_THROW(m.SolveInPlace(b));
+}
@@ -0,0 +1,214 @@
+#include "utmatrix.h"
+
+#include <gtest.h>
+#include "parallel_guard.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+
+TEST(TParallel, task_group_runs_all_tasks)
+{
+	TParallelGuard guard(3);
+	std::atomic<int> done(0);
+	{
+		TTaskGroup group;
+		for (int k = 0; k < 100; k++)
+		{
+			group.Run([&done]() { done++; });
+		}
+		group.Wait();
+	}
+	EXPECT_EQ(100, done);
+}
+
+TEST(TParallel, task_group_rethrows_exception)
+{
+	TParallelGuard guard(2);
+	{
+		TTaskGroup group;
+		group.Run([]() { throw - 1; });
+		EXPECT_ANY_THROW(group.Wait());
+	}
+}
+
+TEST(TParallel, task_group_wait_sleeps_until_long_task_finishes)
+{
+	TParallelGuard guard(2);
+	std::atomic<bool> finished(false);
+	{
+		TTaskGroup group;
+		group.Run([&finished]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			finished = true;
+		});
+		group.Wait();
+		EXPECT_TRUE(finished);
+	}
+}
+
+TEST(TParallel, nested_parallel_range_runs_in_pool_threads)
+{
+	TParallelGuard guard(4);
+	std::vector<int> hits(64 * 64, 0);
+	std::atomic<int> outside(0);
+	std::thread::id caller = std::this_thread::get_id();
+	ParallelRange(64, 1, [&](int from, int to) {
+		for (int i = from; i < to; i++)
+		{
+			ParallelRange(64, 1, [&, i](int f, int t) {
+				if (!TThreadPool::InWorker() && std::this_thread::get_id() != caller)
+				{
+					outside++;
+				}
+				for (int j = f; j < t; j++)
+				{
+					hits[i * 64 + j]++;
+				}
+			});
+		}
+	});
+	EXPECT_EQ(0, outside);
+	for (size_t k = 0; k < hits.size(); k++)
+	{
+		EXPECT_EQ(1, hits[k]);
+	}
+}
+
+TEST(TParallel, parallel_range_splits_into_cache_line_parts)
+{
+	TParallelGuard guard(4);
+	const int n = 1001;
+	std::vector<int> hits(n, 0);
+	std::vector<std::pair<int, int> > parts(4, std::make_pair(-1, -1));
+	ParallelRange(n, 8, [&](int from, int to) {
+		parts[from / 248] = std::make_pair(from, to);
+		for (int k = from; k < to; k++)
+		{
+			hits[k]++;
+		}
+	});
+	for (int k = 0; k < n; k++)
+	{
+		EXPECT_EQ(1, hits[k]);
+	}
+	for (int p = 0; p < 4; p++)
+	{
+		EXPECT_EQ(0, parts[p].first % 8);
+		EXPECT_LE(parts[p].second - parts[p].first, 256);
+	}
+}
+
+TEST(TParallel, parallel_range_rethrows_exception_from_part)
+{
+	TParallelGuard guard(4);
+	EXPECT_ANY_THROW(ParallelRange(1000, 1, [](int from, int) { if (from > 0) throw - 1; }));
+}
+
+TEST(TParallel, parallel_tasks_runs_each_task_once)
+{
+	TParallelGuard guard(3);
+	std::vector<std::atomic<int> > hits(500);
+	for (size_t t = 0; t < hits.size(); t++)
+	{
+		hits[t] = 0;
+	}
+	ParallelTasks(500, [&hits](int t) { hits[t]++; });
+	for (size_t t = 0; t < hits.size(); t++)
+	{
+		EXPECT_EQ(1, hits[t]);
+	}
+}
+
+TEST(TParallel, set_threads_changes_thread_count)
+{
+	TParallelGuard guard(3);
+	EXPECT_EQ(3, GetParallelThreads());
+	SetParallelThreads(5);
+	EXPECT_EQ(5, GetParallelThreads());
+	SetParallelThreads(0);
+	EXPECT_EQ(1, GetParallelThreads());
+}
+
+TEST(TParallel, set_threads_waits_for_running_operations)
+{
+	TParallelGuard guard(4);
+	std::atomic<bool> started(false);
+	std::atomic<int> done(0);
+	std::thread user([&]() {
+		ParallelTasks(8, [&](int) {
+			started = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			done++;
+		});
+	});
+	while (!started)
+	{
+		std::this_thread::yield();
+	}
+	SetParallelThreads(2);
+	EXPECT_EQ(8, done);
+	EXPECT_EQ(2, GetParallelThreads());
+	user.join();
+}
+
+TEST(TParallel, cant_set_threads_inside_parallel_operation)
+{
+	TParallelGuard guard(2);
+	std::atomic<int> thrown(0);
+	ParallelTasks(2, [&thrown](int) {
+		try {
+			SetParallelThreads(3);
+		}
+		catch (...) {
+			thrown++;
+		}
+	});
+	EXPECT_EQ(2, thrown);
+	EXPECT_EQ(2, GetParallelThreads());
+}
+
+TEST(TParallel, parallel_parts_respects_max_parts)
+{
+	TParallelGuard guard(4);
+	std::vector<int> hits(1000, 0);
+	int parts = ParallelParts(1000, 8, 3, [&hits](int, int from, int to) {
+		for (int k = from; k < to; k++)
+		{
+			hits[k]++;
+		}
+	});
+	EXPECT_EQ(3, parts);
+	for (size_t k = 0; k < hits.size(); k++)
+	{
+		EXPECT_EQ(1, hits[k]);
+	}
+}
+
+TEST(TParallel, parallel_sum_is_correct_while_threads_change)
+{
+	TParallelGuard guard(2);
+	std::atomic<bool> stop(false);
+	std::thread setter([&stop]() {
+		for (int k = 0; !stop; k++)
+		{
+			SetParallelThreads(k % 2 ? 8 : 2);
+		}
+	});
+	for (int r = 0; r < 200; r++)
+	{
+		long long sum = ParallelSum<long long>(1000, 1, [](int from, int to) {
+			long long s = 0;
+			for (int k = from; k < to; k++)
+			{
+				s += k;
+			}
+			return s;
+		});
+		EXPECT_EQ(999 * 1000 / 2, sum);
+	}
+	stop = true;
+	setter.join();
+}
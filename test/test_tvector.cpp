@@ -1,6 +1,11 @@
 #include "utmatrix.h"
 
 #include <gtest.h>
+#include "alloc_counter.h"
+#include "parallel_guard.h"
+
+#include <thread>
+#include <vector>
 
 TEST(TVector, can_create_vector_with_positive_length)
 {
@@ -275,3 +280,767 @@ TEST(TVector, cant_multiply_vectors_with_not_equal_size)
 	ASSERT_ANY_THROW(v1 * v2);
 }
 
+
+TEST(TVector, move_constructor_takes_memory_of_source)
+{
+	TVector<int> v(5);
+	int *p = &v[0];
+	TVector<int> w(std::move(v));
+	EXPECT_EQ(p, &w[0]);
+	EXPECT_EQ(0, v.GetSize());
+}
+
+TEST(TVector, move_assignment_takes_memory_of_source)
+{
+	TVector<int> v(5), w(3);
+	int *p = &v[0];
+	w = std::move(v);
+	EXPECT_EQ(p, &w[0]);
+	EXPECT_EQ(5, w.GetSize());
+}
+
+TEST(TVector, move_constructor_does_not_allocate)
+{
+	TVector<int> v(5);
+	AllocationCount = 0;
+	TVector<int> w(std::move(v));
+	EXPECT_EQ(0, AllocationCount);
+}
+
+TEST(TVector, assigning_sum_allocates_only_result)
+{
+	TVector<int> v1(5), v2(5), res(3);
+	AllocationCount = 0;
+	res = v1 + v2;
+	EXPECT_EQ(1, AllocationCount);
+}
+
+TEST(TVector, can_evaluate_chain_of_operations)
+{
+	const int size = 5;
+	TVector<int> a(size), b(size), c(size), testv(size);
+	for (int i = 0; i < size; i++)
+	{
+		a[i] = i;
+		b[i] = i * i;
+		c[i] = i + 1;
+		testv[i] = a[i] + b[i] - c[i] * 2;
+	}
+	TVector<int> res(a + b - c * 2);
+	EXPECT_EQ(testv, res);
+	EXPECT_TRUE(testv == a + b - c * 2);
+}
+
+TEST(TVector, chain_of_operations_allocates_only_result)
+{
+	TVector<int> a(5), b(5), c(5);
+	AllocationCount = 0;
+	TVector<int> res(a + b - c * 2);
+	EXPECT_EQ(1, AllocationCount);
+}
+
+TEST(TVector, assigning_chain_to_vector_of_equal_size_does_not_allocate)
+{
+	TVector<int> a(5), b(5), c(5), res(5);
+	AllocationCount = 0;
+	res = a + b - c * 2 + 1;
+	EXPECT_EQ(0, AllocationCount);
+}
+
+TEST(TVector, can_use_vector_in_its_own_expression)
+{
+	const int size = 5;
+	TVector<int> a(size), b(size), testv(size);
+	for (int i = 0; i < size; i++)
+	{
+		a[i] = i;
+		b[i] = 1;
+		testv[i] = i * 2 + 1;
+	}
+	a = a + a + b;
+	EXPECT_EQ(testv, a);
+}
+
+TEST(TVector, cant_build_chain_with_vectors_of_not_equal_size)
+{
+	TVector<int> a(5), b(5), c(2);
+	ASSERT_ANY_THROW(a + b - c);
+}
+
+TEST(TVector, simd_kernels_match_scalar_results_on_every_level)
+{
+	const int size = 37;
+	TVector<int> a(size), b(size);
+	TVector<long long> la(size), lb(size);
+	TVector<float> fa(size), fb(size);
+	TVector<double> da(size), db(size);
+	for (int i = 0; i < size; i++)
+	{
+		a[i] = i * 3 - 20;         b[i] = 7 - i;
+		la[i] = (long long)i << 33; lb[i] = i - 5;
+		fa[i] = i * 0.5f;          fb[i] = 1.0f - i;
+		da[i] = i * 0.25;          db[i] = i + 2.0;
+	}
+	int top = GetSimdLevel();
+	for (int level = SIMD_NONE; level <= top; level++)
+	{
+		SetSimdLevel(level);
+		TVector<int> s(a + b), d(a - b), m(a * 3);
+		TVector<long long> ls(la + lb), ld(la - lb), lm(la * 3);
+		TVector<float> fs(fa + fb), fm(fa * 2.0f);
+		TVector<double> ds(da - db), dm(da * 4.0);
+		for (int i = 0; i < size; i++)
+		{
+			EXPECT_EQ(a[i] + b[i], s[i]);
+			EXPECT_EQ(a[i] - b[i], d[i]);
+			EXPECT_EQ(a[i] * 3, m[i]);
+			EXPECT_EQ(la[i] + lb[i], ls[i]);
+			EXPECT_EQ(la[i] - lb[i], ld[i]);
+			EXPECT_EQ(la[i] * 3, lm[i]);
+			EXPECT_EQ(fa[i] + fb[i], fs[i]);
+			EXPECT_EQ(fa[i] * 2.0f, fm[i]);
+			EXPECT_EQ(da[i] - db[i], ds[i]);
+			EXPECT_EQ(da[i] * 4.0, dm[i]);
+		}
+	}
+	SetSimdLevel(top);
+}
+
+TEST(TVector, simd_scalar_product_matches_serial_sum_on_every_level)
+{
+	const int size = 203;
+	TVector<int> a(size), b(size);
+	TVector<long long> la(size), lb(size);
+	TVector<float> fa(size), fb(size);
+	TVector<double> da(size), db(size);
+	int test = 0;
+	long long ltest = 0;
+	double dtest = 0;
+	for (int i = 0; i < size; i++)
+	{
+		a[i] = i % 13 - 6;  b[i] = i % 7 - 3;
+		la[i] = i * 1000003LL; lb[i] = i % 5 - 2;
+		fa[i] = (float)(i % 9); fb[i] = (float)(i % 4 - 1);
+		da[i] = i % 11;     db[i] = i % 3 - 1;
+		test += a[i] * b[i];
+		ltest += la[i] * lb[i];
+		dtest += da[i] * db[i];
+	}
+	float ftest = 0;
+	for (int i = 0; i < size; i++)
+	{
+		ftest += fa[i] * fb[i];
+	}
+	int top = GetSimdLevel();
+	for (int level = SIMD_NONE; level <= top; level++)
+	{
+		SetSimdLevel(level);
+		EXPECT_EQ(test, a * b);
+		EXPECT_EQ(ltest, la * lb);
+		EXPECT_EQ(ftest, fa * fb);
+		EXPECT_EQ(dtest, da * db);
+	}
+	SetSimdLevel(top);
+}
+
+TEST(TVector, compound_operators_change_vector_in_place)
+{
+	const int size = 5;
+	TVector<int> v(size), w(size), testv(size);
+	for (int i = 0; i < size; i++)
+	{
+		v[i] = i;
+		w[i] = i * i;
+		testv[i] = ((i + 1 + i * i - 2 * i * i) - 3) * 2;
+	}
+	int *p = &v[0];
+	v += 1;
+	v += w;
+	v -= w + w;
+	v -= 3;
+	v *= 2;
+	EXPECT_EQ(testv, v);
+	EXPECT_EQ(p, &v[0]);
+}
+
+TEST(TVector, compound_operators_do_not_allocate)
+{
+	TVector<int> v(5), w(5);
+	AllocationCount = 0;
+	for (int i = 0; i < 10; i++)
+	{
+		v += w;
+		v -= w * 2;
+		v *= 3;
+	}
+	EXPECT_EQ(0, AllocationCount);
+}
+
+TEST(TVector, cant_add_in_place_vector_with_not_equal_size)
+{
+	TVector<int> v(5), w(2);
+	ASSERT_ANY_THROW(v += w);
+}
+
+TEST(TVector, at_throws_when_index_out_of_range_for_any_policy)
+{
+	TVector<int> v(5, 2);
+	TVector<int, TNoBoundsCheck> w(5, 2);
+	ASSERT_ANY_THROW(v.at(1));
+	ASSERT_ANY_THROW(w.at(7));
+	ASSERT_NO_THROW(w.at(6));
+}
+
+TEST(TVector, unchecked_vector_gives_access_with_start_index)
+{
+	TVector<int, TNoBoundsCheck> v(4, 3);
+	for (int i = 3; i < 7; i++)
+	{
+		v[i] = i * 2;
+	}
+	EXPECT_EQ(6, v[3]);
+	EXPECT_EQ(12, v.at(6));
+}
+
+TEST(TVector, debug_policy_checks_only_without_ndebug)
+{
+	TVector<int, TDebugBoundsCheck> v(4);
+#ifdef NDEBUG
+	EXPECT_FALSE(TDebugBoundsCheck::Enabled);
+#else
+	ASSERT_ANY_THROW(v[4]);
+#endif
+	ASSERT_ANY_THROW(v.at(4));
+}
+
+TEST(TVector, can_convert_vector_to_other_policy)
+{
+	TVector<int> v(3);
+	for (int i = 0; i < 3; i++)
+	{
+		v[i] = i + 1;
+	}
+	TVector<int, TNoBoundsCheck> w(v);
+	EXPECT_TRUE(w == v);
+	EXPECT_EQ(v * 2, w * 2);
+}
+
+TEST(TVector, can_read_element_of_const_vector)
+{
+	TVector<int> v(3, 1);
+	v[2] = 5;
+	const TVector<int> &c = v;
+	EXPECT_EQ(5, c[2]);
+	ASSERT_ANY_THROW(c[0]);
+}
+
+TEST(TVector, vector_memory_is_aligned)
+{
+	for (int n = 1; n < 40; n++)
+	{
+		TVector<double> v(n);
+		TVector<char> c(n);
+		EXPECT_EQ(0u, (size_t)&v[0] % VECTOR_ALIGNMENT);
+		EXPECT_EQ(0u, (size_t)&c[0] % VECTOR_ALIGNMENT);
+	}
+}
+
+TEST(TVector, vector_memory_stays_aligned_after_reallocation)
+{
+	TVector<double> v(3), w(17);
+	v = w;
+	EXPECT_EQ(0u, (size_t)&v[0] % VECTOR_ALIGNMENT);
+	TVector<double> s(w + w);
+	EXPECT_EQ(0u, (size_t)&s[0] % VECTOR_ALIGNMENT);
+}
+
+TEST(TVector, can_create_vector_filled_with_value)
+{
+	TVector<double> v(5, 2, 1.5);
+	EXPECT_EQ(5, v.GetSize());
+	EXPECT_EQ(2, v.GetStartIndex());
+	for (int i = 2; i < 7; i++)
+	{
+		EXPECT_EQ(1.5, v[i]);
+	}
+	ASSERT_ANY_THROW(TVector<double> w(-1, 0, 1.0));
+}
+
+TEST(TVector, can_create_zero_vector)
+{
+	TVector<int> v(100, 0, ZERO_INIT);
+	for (int i = 0; i < 100; i++)
+	{
+		EXPECT_EQ(0, v[i]);
+	}
+	ASSERT_ANY_THROW(TVector<int> w(MAX_VECTOR_SIZE + 1, 0, ZERO_INIT));
+}
+
+TEST(TVector, large_zero_vector_is_zero_and_aligned)
+{
+	const int size = 1 << 20;
+	TVector<double> v(size, 0, ZERO_INIT);
+	EXPECT_EQ(0u, (size_t)&v[0] % VECTOR_ALIGNMENT);
+	EXPECT_EQ(0.0, v * v);
+	v[size - 1] = 2;
+	TVector<double> w(v);
+	EXPECT_EQ(4.0, v * w);
+}
+
+TEST(TVector, zero_vector_of_vectors_holds_default_elements)
+{
+	TVector<TVector<int> > v(3, 0, ZERO_INIT);
+	for (int i = 0; i < 3; i++)
+	{
+		EXPECT_EQ(10, v[i].GetSize());
+	}
+}
+
+TEST(TVector, assign_to_smaller_size_reuses_buffer)
+{
+	TVector<int> v(10), small(4), big(10);
+	int *p = &v[0];
+	int before = AllocationCount;
+	v = small;
+	EXPECT_EQ(4, v.GetSize());
+	EXPECT_EQ(10, v.GetCapacity());
+	v = big;
+	EXPECT_EQ(10, v.GetSize());
+	EXPECT_EQ(before, AllocationCount);
+	EXPECT_EQ(p, &v[0]);
+}
+
+TEST(TVector, reserve_keeps_elements_and_avoids_reallocation)
+{
+	TVector<int> v(3);
+	for (int i = 0; i < 3; i++)
+	{
+		v[i] = i + 1;
+	}
+	v.reserve(20);
+	EXPECT_EQ(20, v.GetCapacity());
+	EXPECT_EQ(3, v.GetSize());
+	EXPECT_EQ(3, v[2]);
+	TVector<int> w(15);
+	int before = AllocationCount;
+	v = w;
+	v = w + w;
+	EXPECT_EQ(before, AllocationCount);
+	ASSERT_ANY_THROW(v.reserve(-1));
+}
+
+TEST(TVector, shrink_to_fit_releases_extra_capacity)
+{
+	TVector<int> v(10), small(2);
+	small[0] = 7;
+	small[1] = 8;
+	v = small;
+	v.shrink_to_fit();
+	EXPECT_EQ(2, v.GetCapacity());
+	EXPECT_EQ(small, v);
+}
+
+TEST(TVector, pool_allocator_reuses_freed_buffer)
+{
+	typedef TVector<double, TBoundsCheck, TPoolAlloc> TPoolVector;
+	const double *first;
+	{
+		TPoolVector v(100);
+		first = &v[0];
+	}
+	int before = AllocationCount;
+	TPoolVector w(90);
+	EXPECT_EQ(before, AllocationCount);
+	EXPECT_EQ(first, &w[0]);
+	EXPECT_EQ(0u, (size_t)&w[0] % VECTOR_ALIGNMENT);
+}
+
+TEST(TVector, arena_allocator_releases_memory_at_scope_exit)
+{
+	typedef TVector<int, TBoundsCheck, TArenaAlloc> TArenaVector;
+	size_t used = TArenaAlloc::Used();
+	{
+		TArenaScope scope;
+		TArenaVector a(10), b(10);
+		for (int i = 0; i < 10; i++)
+		{
+			a[i] = i;
+			b[i] = 2 * i;
+		}
+		int before = AllocationCount;
+		for (int k = 0; k < 100; k++)
+		{
+			TArenaVector c(a + b);
+			EXPECT_EQ(3 * 9, c[9]);
+		}
+		EXPECT_EQ(before, AllocationCount);
+	}
+	EXPECT_EQ(used, TArenaAlloc::Used());
+}
+
+TEST(TVector, vectors_with_different_allocators_can_be_combined)
+{
+	TVector<int, TBoundsCheck, TPoolAlloc> a(4);
+	TVector<int> b(4);
+	for (int i = 0; i < 4; i++)
+	{
+		a[i] = i;
+		b[i] = 10;
+	}
+	TVector<int> c(a + b);
+	EXPECT_EQ(13, c[3]);
+	EXPECT_TRUE(c - b == a);
+}
+
+typedef TVector<int, TBoundsCheck, TCowAlloc<> > TCowVector;
+
+TEST(TVector, cow_copy_shares_buffer)
+{
+	TCowVector w(1000);
+	for (int i = 0; i < 1000; i++)
+	{
+		w[i] = i;
+	}
+	TCowVector v(w), d(5); // w    operator[],  v - 
+	int before = AllocationCount;
+	TCowVector c(v);
+	d = v;
+	EXPECT_EQ(before, AllocationCount);
+	const TCowVector &cc = c;
+	const TCowVector &cv = v;
+	EXPECT_EQ(&cv[0], &cc[0]);
+	EXPECT_EQ(v, d);
+}
+
+TEST(TVector, cow_write_detaches_copy)
+{
+	TCowVector w(10);
+	for (int i = 0; i < 10; i++)
+	{
+		w[i] = i;
+	}
+	TCowVector v(w), c(v);
+	int before = AllocationCount;
+	c[3] = 100;
+	EXPECT_EQ(before + 1, AllocationCount);
+	EXPECT_EQ(3, v[3]);
+	EXPECT_EQ(100, c[3]);
+	c[4] = 200; //   
+	EXPECT_EQ(before + 1, AllocationCount);
+}
+
+TEST(TVector, cow_element_reference_does_not_change_later_copies)
+{
+	TCowVector v(4, 0, 1);
+	int &r = v[0];
+	TCowVector c(v);
+	r = 5;
+	EXPECT_EQ(5, v[0]);
+	EXPECT_EQ(1, c[0]);
+	int &s = v.at(1);
+	TCowVector d(v);
+	s = 7;
+	EXPECT_EQ(7, v[1]);
+	EXPECT_EQ(1, d[1]);
+}
+
+TEST(TVector, cow_in_place_operations_do_not_change_copies)
+{
+	TCowVector v(4, 0, 1);
+	TCowVector c(v), d(v);
+	c += 5;
+	d += v;
+	EXPECT_EQ(1, v[0]);
+	EXPECT_EQ(6, c[0]);
+	EXPECT_EQ(2, d[0]);
+	TCowVector e(v);
+	e = v + v;
+	EXPECT_EQ(1, v[3]);
+	EXPECT_EQ(2, e[3]);
+}
+
+TEST(TVector, cow_copy_outlives_original)
+{
+	TCowVector *v = new TCowVector(3, 0, 7);
+	TCowVector c(*v);
+	delete v;
+	EXPECT_EQ(7, c[2]);
+}
+
+TEST(TVector, cow_reference_count_is_thread_safe)
+{
+	TCowVector v(100, 0, 1);
+	vector<thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.push_back(thread([&v]() {
+			const TCowVector &cv = v;
+			for (int k = 0; k < 10000; k++)
+			{
+				TCowVector c(cv);
+				if (c.GetSize() != 100) abort();
+			}
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+	{
+		threads[t].join();
+	}
+	int before = AllocationCount;
+	v[0] = 2; //   :  
+	EXPECT_EQ(before, AllocationCount);
+}
+
+TEST(TVector, view_refers_to_vector_elements)
+{
+	TVector<int> v(10, 2);
+	for (int i = 2; i < 12; i++)
+	{
+		v[i] = i;
+	}
+	int before = AllocationCount;
+	TVectorView<int> w = v.View(4, 8);
+	EXPECT_EQ(before, AllocationCount);
+	EXPECT_EQ(4, w.GetSize());
+	EXPECT_EQ(4, w.GetStartIndex());
+	EXPECT_EQ(7, w[7]);
+	w[5] = 50;
+	EXPECT_EQ(50, v[5]);
+	ASSERT_ANY_THROW(w[8]);
+}
+
+TEST(TVector, view_can_be_used_in_arithmetic)
+{
+	TVector<int> v(6), u(3);
+	for (int i = 0; i < 6; i++)
+	{
+		v[i] = i;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		u[i] = 1;
+	}
+	const TVector<int> &cv = v;
+	TVector<int> s(cv.View(3, 6) + u);
+	EXPECT_EQ(3, s.GetStartIndex());
+	EXPECT_EQ(4, s[3]);
+	EXPECT_EQ(6, s[5]);
+	EXPECT_EQ(3 + 4 + 5, cv.View(3, 6) * u);
+	TVectorView<int> w = v.View(0, 3);
+	w += u;
+	EXPECT_EQ(1, v[0]);
+	EXPECT_EQ(3, v[2]);
+	EXPECT_EQ(3, v[3]);
+}
+
+TEST(TVector, cant_create_view_out_of_range_or_resize_it)
+{
+	TVector<int> v(5, 1);
+	ASSERT_ANY_THROW(v.View(0, 3));
+	ASSERT_ANY_THROW(v.View(2, 7));
+	ASSERT_ANY_THROW(v.View(4, 3));
+	TVectorView<int> w = v.View(1, 3);
+	TVector<int> u(3);
+	ASSERT_ANY_THROW(w = u);
+	ASSERT_ANY_THROW(w[3]);
+	ASSERT_ANY_THROW(w.View(1, 4));
+}
+
+TEST(TVector, copy_of_view_aliases_and_assignment_writes_elements)
+{
+	TVector<int> a(4, 0, 1);
+	TVectorView<int> p = a.View(0, 2), q = a.View(2, 4);
+	TVectorView<int> alias(p); //       
+	alias[0] = 7;
+	EXPECT_EQ(7, a[0]);
+	q = p; //  ,    
+	EXPECT_EQ(7, a[2]);
+	EXPECT_EQ(2, q.GetStartIndex());
+	q -= p;
+	EXPECT_EQ(0, a[2]);
+	EXPECT_EQ(0, a[3]);
+}
+
+TEST(TVector, vector_built_or_assigned_from_view_copies_elements)
+{
+	TVector<int> a(4, 0, 1);
+	TVector<int> x = a.View(0, 2), y(5);
+	y = a.View(0, 2);
+	x[0] = 5;
+	y[1] = 6;
+	EXPECT_EQ(1, a[0]);
+	EXPECT_EQ(1, a[1]);
+	EXPECT_EQ(2, y.GetSize());
+}
+
+TEST(TVector, view_of_const_vector_is_read_only)
+{
+	TVector<int> v(4, 0, 1);
+	const TVector<int> &cv = v;
+	EXPECT_TRUE((is_same<decltype(cv.View(0, 2)[0]), const int&>::value));
+	EXPECT_TRUE((is_same<decltype(v.View(0, 2)[0]), int&>::value));
+	TVectorView<const int> all = v; //   -    
+	TVectorView<const int> part = v.View(1, 3);
+	EXPECT_EQ(4, all.GetSize());
+	EXPECT_EQ(1 + 1, part * part);
+	TVector<int> c = cv.View(0, 2);
+	c[0] = 5;
+	EXPECT_EQ(1, v[0]);
+}
+
+TEST(TVector, view_of_cow_vector_does_not_change_copies)
+{
+	TCowVector v(4, 0, 1);
+	TCowVector c(v);
+	TVectorView<int> w = v.View(0, 2);
+	w[0] = 9;
+	EXPECT_EQ(9, v[0]);
+	EXPECT_EQ(1, c[0]);
+}
+
+TEST(TVector, const_view_of_cow_vector_follows_writes_after_copy)
+{
+	TCowVector v(4, 0, 1);
+	const TCowVector &cv = v;
+	TVectorView<const int> w = cv.View(0, 4);
+	TCowVector *c = new TCowVector(v);
+	v[0] = 42;
+	EXPECT_EQ(42, v[0]);
+	EXPECT_EQ(42, w[0]);
+	EXPECT_EQ(1, (*c)[0]);
+	delete c;
+	EXPECT_EQ(42, w[0]);
+	TCowVector d(v), e(d); // d  e -    
+	TVectorView<const int> dw = static_cast<const TCowVector&>(d).View(0, 4);
+	d[1] = 7;
+	EXPECT_EQ(7, dw[1]);
+	EXPECT_EQ(1, e[1]);
+}
+
+TEST(TVector, copies_of_cow_vector_with_view_do_not_share_buffer)
+{
+	TCowVector v(4, 0, 1);
+	TVectorView<int> w = v.View(0, 2);
+	TCowVector c(v), d(2);
+	d = v;
+	w[0] = 9;
+	EXPECT_EQ(9, v[0]);
+	EXPECT_EQ(1, c[0]);
+	EXPECT_EQ(1, d[0]);
+	TCowVector e(4, 0, 5);
+	TVectorView<int> ew = e.View(0, 4);
+	e = c; //  e  :    
+	EXPECT_EQ(1, ew[0]);
+	ew[1] = 3;
+	EXPECT_EQ(1, c[1]);
+}
+
+typedef TVector<double, TBoundsCheck, TSmallAlloc<16> > TSmallVector;
+
+TEST(TVector, short_vector_lives_inside_object)
+{
+	int before = AllocationCount;
+	TSmallVector v(16, 0, 1.0);
+	TSmallVector w(v);
+	TSmallVector s(v + w);
+	EXPECT_EQ(before, AllocationCount);
+	EXPECT_EQ(2.0, s[15]);
+	const char *obj = reinterpret_cast<const char*>(&v);
+	const char *elem = reinterpret_cast<const char*>(&v[0]);
+	EXPECT_TRUE(elem >= obj && elem < obj + sizeof(v));
+}
+
+TEST(TVector, long_small_buffer_vector_uses_heap)
+{
+	int before = AllocationCount;
+	TSmallVector v(17, 0, 1.0);
+	EXPECT_EQ(before + 1, AllocationCount);
+	EXPECT_EQ(17.0, v * v);
+}
+
+TEST(TVector, can_move_short_vector)
+{
+	TSmallVector v(3, 0, 2.0);
+	TSmallVector w(std::move(v));
+	EXPECT_EQ(3, w.GetSize());
+	EXPECT_EQ(2.0, w[2]);
+	EXPECT_EQ(0, v.GetSize());
+	TSmallVector u(20);
+	u = std::move(w);
+	EXPECT_EQ(3, u.GetSize());
+	EXPECT_EQ(2.0, u[1]);
+}
+
+// ,    
+struct TThrowingMove
+{
+	static bool Armed;
+	int Val;
+
+	TThrowingMove(): Val(0) {}
+	TThrowingMove(const TThrowingMove &) = default;
+	TThrowingMove& operator=(const TThrowingMove &) = default;
+	TThrowingMove& operator=(TThrowingMove &&t)
+	{
+		if (Armed) throw - 1;
+		Val = t.Val;
+		return *this;
+	}
+};
+
+bool TThrowingMove::Armed = false;
+
+TEST(TVector, move_constructor_is_noexcept_only_when_elements_cannot_throw)
+{
+	typedef TVector<TThrowingMove, TBoundsCheck, TSmallAlloc<4> > TSmallThrowing;
+	EXPECT_TRUE(is_nothrow_move_constructible<TSmallVector>::value);
+	EXPECT_TRUE((is_nothrow_move_constructible<TVector<TThrowingMove> >::value));
+	EXPECT_FALSE(is_nothrow_move_constructible<TSmallThrowing>::value);
+	TSmallThrowing v(3);
+	v[1].Val = 5;
+	TThrowingMove::Armed = true;
+	EXPECT_ANY_THROW(TSmallThrowing w(std::move(v)));
+	TThrowingMove::Armed = false;
+	EXPECT_EQ(5, v[1].Val);
+}
+
+TEST(TVector, small_buffer_vector_switches_between_inline_and_heap_storage)
+{
+	TSmallVector v(4, 0, 1.0), big(40, 0, 3.0), small(2, 0, 5.0);
+	v = big;
+	EXPECT_EQ(40, v.GetSize());
+	EXPECT_EQ(3.0, v[39]);
+	v = small;
+	v.shrink_to_fit();
+	EXPECT_EQ(16, v.GetCapacity());
+	EXPECT_EQ(5.0, v[1]);
+	int before = AllocationCount;
+	TSmallVector c(v);
+	EXPECT_EQ(before, AllocationCount);
+	v.reserve(100);
+	EXPECT_EQ(100, v.GetCapacity());
+	EXPECT_EQ(5.0, v[0]);
+}
+
+TEST(TVector, parallel_operations_match_serial)
+{
+	const int n = 1000;
+	TVector<double> a(n), b(n);
+	for (int i = 0; i < n; i++)
+	{
+		a[i] = i % 13;
+		b[i] = 0.5 * (i % 7);
+	}
+	TVector<double> sum(a + b), scaled(a * 2.0);
+	double dot = a * b;
+	TParallelGuard guard(4);
+	TVector<double> psum(a + b), pscaled(a);
+	pscaled *= 2.0;
+	TVector<double> acc(a);
+	acc += b;
+	double pdot = a * b;
+	EXPECT_EQ(sum, psum);
+	EXPECT_EQ(scaled, pscaled);
+	EXPECT_EQ(sum, acc);
+	EXPECT_DOUBLE_EQ(dot, pdot);
+}